@@ -12,6 +12,7 @@ struct action {
 extern struct action act_left;
 extern struct action act_right;
 extern struct action act_jump;
+extern struct action act_stats;
 
 bool act_just_pressed(struct action *act);
 
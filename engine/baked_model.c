@@ -0,0 +1,196 @@
+#include "baked_model.h"
+
+#include "engine/serialize/serialize_skm.h"
+#include "engine/serialize/serialize_stm.h"
+
+#include "alloc.h"
+
+#include <string.h>
+
+bool
+write_baked_model(const char *path, struct import_data *id) {
+    // Most of what we write is individual fields, so don't make each of them
+    // a separate fwrite.
+    struct serializer *s = get_buffered_writer(get_stdio_writer(path));
+    if(!s) {
+        SDL_Log("baked model: could not open %s for writing", path);
+        return false;
+    }
+
+    write_u32(s, BAKED_MODEL_MAGIC);
+    write_u32(s, BAKED_MODEL_VERSION);
+
+    write_u32(s, (uint32_t)id->got_skm);
+    for(size_t i = 0; i < id->got_skm; ++i) {
+        write_skm(s, id->skm[i]);
+    }
+
+    write_u32(s, (uint32_t)id->got_stm);
+    for(size_t i = 0; i < id->got_stm; ++i) {
+        write_stm(s, id->stm[i]);
+    }
+
+    write_u32(s, (uint32_t)id->got_skm_arm_anim);
+    for(size_t i = 0; i < id->got_skm_arm_anim; ++i) {
+        struct skm_armature_anim *anim = id->skm_arm_anim[i];
+
+        // The loader reads the animation with this mesh's bone count, so
+        // guessing would misread it.
+        uint32_t mesh_idx = UINT32_MAX;
+        for(size_t j = 0; j < id->got_skm; ++j) {
+            if(id->skm[j] == anim->skm) mesh_idx = (uint32_t)j;
+        }
+        if(mesh_idx == UINT32_MAX) {
+            SDL_Log("baked model: animation %zu in %s has no mesh", i, path);
+            close_writer(s);
+            return false;
+        }
+
+        write_u32(s, mesh_idx);
+        write_skm_anim(s, anim);
+    }
+
+    write_u32(s, (uint32_t)id->got_texture);
+    for(size_t i = 0; i < id->got_texture; ++i) {
+        struct import_texture *tex = &id->texture_data[i];
+        write_u8_array(s, strlen(tex->format), (uint8_t*)tex->format);
+        write_u8_array(s, tex->size, tex->data);
+    }
+
+    if(!close_writer(s)) {
+        SDL_Log("baked model: could not write all of %s", path);
+        return false;
+    }
+    return true;
+}
+
+static void
+free_skm_data(struct skeletal_mesh *skm) {
+    eng_free(skm->vertices, sizeof(*skm->vertices) * skm->vertices_count);
+    eng_free(skm->triangles, sizeof(*skm->triangles) * skm->triangles_count);
+    eng_free(skm->bone_inverse_bind, sizeof(*skm->bone_inverse_bind) * skm->bone_count);
+    eng_free(skm->bone_local_pose, sizeof(*skm->bone_local_pose) * skm->bone_count);
+    eng_free(skm->bone_heirarchy, sizeof(*skm->bone_heirarchy) * skm->bone_count);
+}
+
+static void
+free_anim_data(struct skm_armature_anim *anim) {
+    if(!anim->bones) return;
+    for(size_t i = 0; i < anim->skm->bone_count; ++i) {
+        struct skm_arm_anim_bone *bone = &anim->bones[i];
+        eng_free(bone->position, sizeof(*bone->position) * bone->position_count);
+        eng_free(bone->scale, sizeof(*bone->scale) * bone->scale_count);
+        eng_free(bone->rotation, sizeof(*bone->rotation) * bone->rotation_count);
+    }
+    eng_free(anim->bones, sizeof(*anim->bones) * anim->skm->bone_count);
+}
+
+bool
+load_baked_model(const char *path, struct import_data *id) {
+    // Mapping the file lets textures be handed to the decoder without a copy,
+    // but not every platform (or file system) can do it.
+    struct deserializer *d = get_mmap_reader(path);
+    if(!d) d = get_stdio_reader(path);
+    if(!d) {
+        SDL_Log("baked model: could not open %s", path);
+        return false;
+    }
+
+    uint32_t magic = read_u32(d);
+    uint32_t version = read_u32(d);
+    if(magic != BAKED_MODEL_MAGIC || version != BAKED_MODEL_VERSION) {
+        SDL_Log("baked model: %s is not a version %d baked model, please re-bake it", path, BAKED_MODEL_VERSION);
+        close_reader(d);
+        return false;
+    }
+
+    // Meshes we have no room for still need to be read, both to get past them
+    // and because animations may refer to them by index.
+    size_t mesh_count = read_u32(d);
+    struct skeletal_mesh **meshes = eng_zalloc(sizeof(*meshes) * mesh_count);
+    struct skeletal_mesh *scratch = eng_zalloc(sizeof(*scratch) * mesh_count);
+
+    bool ok = !d->failed;
+    for(size_t i = 0; ok && i < mesh_count; ++i) {
+        meshes[i] = &scratch[i];
+        if(id->got_skm < id->num_skm) {
+            meshes[i] = id->skm[id->got_skm++];
+        }
+
+        // read_skm() would clobber the shader the game already picked.
+        GLuint shader = meshes[i]->shader;
+        ok = read_skm(d, meshes[i]);
+        meshes[i]->shader = shader;
+    }
+
+    // Nothing refers to static meshes, so the ones we have no room for can be
+    // freed straight away.
+    size_t static_count = ok ? read_u32(d) : 0;
+    for(size_t i = 0; ok && i < static_count; ++i) {
+        if(id->got_stm < id->num_stm) {
+            struct static_mesh *stm = id->stm[id->got_stm++];
+            GLuint shader = stm->shader;
+            ok = read_stm(d, stm);
+            stm->shader = shader;
+        }
+        else {
+            struct static_mesh discard = {0};
+            ok = read_stm(d, &discard);
+            stm_destroy(&discard);
+        }
+    }
+
+    size_t anim_count = ok ? read_u32(d) : 0;
+    for(size_t i = 0; ok && i < anim_count; ++i) {
+        uint32_t mesh_idx = read_u32(d);
+        if(mesh_idx >= mesh_count) { ok = false; break; }
+
+        // Like load_model(), animations for meshes we dropped are dropped too.
+        struct skm_armature_anim discard = {0};
+        struct skm_armature_anim *anim = &discard;
+        if(meshes[mesh_idx] != &scratch[mesh_idx] && id->got_skm_arm_anim < id->num_skm_arm_anim) {
+            anim = id->skm_arm_anim[id->got_skm_arm_anim++];
+        }
+
+        ok = read_skm_anim(d, anim, meshes[mesh_idx]);
+        if(anim == &discard) free_anim_data(&discard);
+    }
+
+    size_t texture_count = ok ? read_u32(d) : 0;
+    for(size_t i = 0; ok && i < texture_count; ++i) {
+        size_t format_len, size;
+        bool format_owned, data_owned;
+        uint8_t *format = view_u8_array(d, &format_len, &format_owned);
+        uint8_t *data = view_u8_array(d, &size, &data_owned);
+        ok = !d->failed;
+
+        if(ok && id->got_texture < id->num_texture) {
+            GLuint *output = &id->texture[id->got_texture++];
+            if(format_len == 3 && !memcmp(format, "png", 3)) {
+                *output = upload_embedded_texture(data, size);
+            }
+        }
+
+        if(format_owned) eng_free(format, format_len);
+        if(data_owned) eng_free(data, size);
+    }
+
+    // The read_* functions drop whatever they read before failing, so this is
+    // the same on the error path.
+    for(size_t i = 0; i < mesh_count; ++i) {
+        if(meshes[i] == &scratch[i]) free_skm_data(&scratch[i]);
+    }
+    eng_free(scratch, sizeof(*scratch) * mesh_count);
+    eng_free(meshes, sizeof(*meshes) * mesh_count);
+
+    ok = ok && !d->failed;
+    close_reader(d);
+
+    if(!ok) {
+        SDL_Log("baked model: %s is truncated or corrupt", path);
+        return false;
+    }
+
+    SDL_Log("model: loaded baked %s\n", path);
+    return true;
+}
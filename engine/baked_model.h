@@ -0,0 +1,36 @@
+#ifndef ENG_BAKED_MODEL_H
+#define ENG_BAKED_MODEL_H
+
+#include "model.h"
+
+/* Baked models are what bake_model() produces from an assimp-readable file:
+ * every skinned mesh (vertices, triangles, bones), every mesh without bones
+ * (as a static mesh), every animation that could be
+ * matched to a mesh, and every embedded texture in its encoded form. They
+ * are written with engine/serialize, and can be read back in a single pass
+ * without assimp.
+ *
+ * Layout (all little-endian, arrays padded so their elements are aligned):
+ *   u32 magic, u32 version
+ *   u32 mesh count,      then write_skm() for each mesh
+ *   u32 static count,    then write_stm() for each static mesh
+ *   u32 animation count, then for each: u32 mesh index, write_skm_anim()
+ *   u32 texture count,   then for each: u8 array format, u8 array data
+ */
+#define BAKED_MODEL_MAGIC   0x444d4242u /* "BBMD" */
+#define BAKED_MODEL_VERSION 4
+
+/**
+ * Writes the contents of an import_data (which must have been filled with
+ * texture_data set) to path. Returns false if the file couldn't be written.
+ */
+bool write_baked_model(const char *path, struct import_data *id);
+
+/**
+ * Loads a baked model into the given import_data, the same way load_model()
+ * would have loaded the original file. Anything the import_data has no room
+ * for is skipped. Returns false if the file couldn't be read.
+ */
+bool load_baked_model(const char *path, struct import_data *id);
+
+#endif
@@ -115,11 +115,13 @@ main_loop(void) {
                 act_update(&act_left, event.key.key, true);
                 act_update(&act_right, event.key.key, true);
                 act_update(&act_jump, event.key.key, true);
+                act_update(&act_stats, event.key.key, true);
                 break;
             case SDL_EVENT_KEY_UP:
                 act_update(&act_left, event.key.key, false);
                 act_update(&act_right, event.key.key, false);
                 act_update(&act_jump, event.key.key, false);
+                act_update(&act_stats, event.key.key, false);
                 break;
         }
         nk_sdl_handle_event(&event);
@@ -159,6 +161,7 @@ main_loop(void) {
         act_tick(&act_left);
         act_tick(&act_right);
         act_tick(&act_jump);
+        act_tick(&act_stats);
         time_in_future -= SPEEDUP(step);
     }
 
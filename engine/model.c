@@ -8,8 +8,10 @@
 
 #include "our_gl.h"
 #include "alloc.h"
+#include "baked_model.h"
 
 #include <assert.h>
+#include <string.h>
 
 struct import_mapping {
     struct aiString *name;
@@ -22,6 +24,367 @@ struct import_mapping {
 struct import_mapping mappings[1024];
 size_t mapping_count = 0xFFFFFFF;
 
+// Maps the aiNode of each bone to its index, so that parents can be looked up
+// in constant time instead of by scanning every bone.
+struct node_index_slot {
+    struct aiNode *node;
+    int idx;
+};
+
+struct node_index {
+    struct node_index_slot *slots;
+    size_t capacity; // Power of two, at least twice the number of bones.
+};
+
+static size_t
+hash_node(struct aiNode *node) {
+    uint64_t x = (uint64_t)(uintptr_t)node;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+static void
+node_index_init(struct node_index *index, size_t count) {
+    index->capacity = 16;
+    while(index->capacity < count * 2) index->capacity *= 2;
+    index->slots = eng_zalloc(sizeof(*index->slots) * index->capacity);
+}
+
+static void
+node_index_free(struct node_index *index) {
+    eng_free(index->slots, sizeof(*index->slots) * index->capacity);
+}
+
+static void
+node_index_put(struct node_index *index, struct aiNode *node, int idx) {
+    size_t mask = index->capacity - 1;
+    size_t i = hash_node(node) & mask;
+    while(index->slots[i].node && index->slots[i].node != node) i = (i + 1) & mask;
+
+    index->slots[i].node = node;
+    index->slots[i].idx = idx;
+}
+
+static int
+node_index_get(struct node_index *index, struct aiNode *node) {
+    size_t mask = index->capacity - 1;
+    for(size_t i = hash_node(node) & mask; index->slots[i].node; i = (i + 1) & mask) {
+        if(index->slots[i].node == node) return index->slots[i].idx;
+    }
+    return -1;
+}
+
+// Reorders the bones of a freshly imported mesh so that every parent comes
+// before its children (see skm_compute_matrices). Everything that refers to
+// bones by index is remapped along with them: the per-bone arrays, the bone
+// indices in the vertex data and the import mappings (which the animations
+// are matched through).
+static void
+sort_bones_parents_first(size_t bone_count, mat4 *inverse_bind, mat4 *local_pose, int *heirarchy,
+    float *vert_data, size_t vert_count, struct import_mapping *bone_mappings) {
+    int *depth = eng_zalloc(sizeof(*depth) * bone_count);
+    int *order = eng_zalloc(sizeof(*order) * bone_count); // new index -> old
+    int *remap = eng_zalloc(sizeof(*remap) * bone_count); // old index -> new
+
+    // Sorting by depth (stably, so that siblings keep their order) puts
+    // parents first. The walk is capped in case the file has a cycle.
+    int max_depth = 0;
+    for(size_t i = 0; i < bone_count; ++i) {
+        int parent = heirarchy[i];
+        while(parent >= 0 && depth[i] < (int)bone_count) {
+            depth[i] += 1;
+            parent = heirarchy[parent];
+        }
+        if(depth[i] > max_depth) max_depth = depth[i];
+    }
+
+    size_t next = 0;
+    for(int d = 0; d <= max_depth; ++d) {
+        for(size_t i = 0; i < bone_count; ++i) {
+            if(depth[i] == d) {
+                remap[i] = (int)next;
+                order[next++] = (int)i;
+            }
+        }
+    }
+
+    mat4 *tmp_mats = eng_zalloc(sizeof(*tmp_mats) * bone_count);
+    int *tmp_heirarchy = eng_zalloc(sizeof(*tmp_heirarchy) * bone_count);
+
+    for(size_t i = 0; i < bone_count; ++i) glm_mat4_copy(inverse_bind[order[i]], tmp_mats[i]);
+    memcpy(inverse_bind, tmp_mats, sizeof(*tmp_mats) * bone_count);
+
+    for(size_t i = 0; i < bone_count; ++i) glm_mat4_copy(local_pose[order[i]], tmp_mats[i]);
+    memcpy(local_pose, tmp_mats, sizeof(*tmp_mats) * bone_count);
+
+    for(size_t i = 0; i < bone_count; ++i) {
+        int parent = heirarchy[order[i]];
+        tmp_heirarchy[i] = parent < 0 ? -1 : remap[parent];
+    }
+    memcpy(heirarchy, tmp_heirarchy, sizeof(*tmp_heirarchy) * bone_count);
+
+    for(size_t v = 0; v < vert_count; ++v) {
+        float *idx = &vert_data[v * SKEL_MESH_4BYTES_COUNT + 10];
+        for(size_t k = 0; k < 4; ++k) {
+            if(idx[k] >= 0) idx[k] = (float)remap[(int)idx[k]];
+        }
+    }
+
+    for(size_t i = 0; i < bone_count; ++i) {
+        bone_mappings[i].skm_bone_idx = remap[bone_mappings[i].skm_bone_idx];
+    }
+
+    eng_free(tmp_heirarchy, sizeof(*tmp_heirarchy) * bone_count);
+    eng_free(tmp_mats, sizeof(*tmp_mats) * bone_count);
+    eng_free(remap, sizeof(*remap) * bone_count);
+    eng_free(order, sizeof(*order) * bone_count);
+    eng_free(depth, sizeof(*depth) * bone_count);
+}
+
+// Import-time index optimization. The exporter writes vertices and faces in
+// whatever order the modelling tool kept them, which is close to the worst
+// case for the GPU's post-transform cache. Every mesh goes through
+// optimize_mesh() before it is handed to skm_init/stm_init:
+//
+//   1. identical vertices (every float, including weights) are welded;
+//   2. triangles are reordered with Tipsify (Sander, Nehab and Barczak,
+//      "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"),
+//      which is linear time and needs no tuning beyond the cache size;
+//   3. vertices are renumbered in the order the triangles first use them, so
+//      that vertex fetches walk the buffer forwards.
+//
+// The ACMR (vertex shader runs per triangle, with a FIFO cache) is logged
+// before and after.
+
+// Small enough to hold on the mobile GPUs WebGL ends up on.
+#define VCACHE_SIZE 16
+
+static float
+mesh_acmr(const uint32_t *tris, size_t index_count, size_t vertex_count) {
+    if(index_count < 3) return 0.0f;
+
+    // A vertex is in the cache if fewer than VCACHE_SIZE misses happened
+    // since its own; stamps start at 0, so misses are counted from 1.
+    size_t *stamp = eng_zalloc(sizeof(*stamp) * vertex_count);
+    size_t misses = 0;
+
+    for(size_t i = 0; i < index_count; ++i) {
+        uint32_t v = tris[i];
+        if(stamp[v] == 0 || misses + 1 - stamp[v] > VCACHE_SIZE) {
+            misses += 1;
+            stamp[v] = misses;
+        }
+    }
+
+    eng_free(stamp, sizeof(*stamp) * vertex_count);
+    return (float)misses / (float)(index_count / 3);
+}
+
+static uint64_t
+hash_vertex(const float *v, size_t stride) {
+    // FNV-1a over the bytes, so that only bitwise identical vertices collide
+    // for real.
+    const uint8_t *bytes = (const uint8_t*)v;
+    uint64_t h = 0xcbf29ce484222325ull;
+    for(size_t i = 0; i < stride * sizeof(float); ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Merges vertices whose stride floats are all identical, rewriting tris to
+// match. Returns the new vertex count; the vertices are compacted in place.
+static size_t
+weld_vertices(float *verts, size_t stride, size_t vertex_count, uint32_t *tris, size_t index_count) {
+    size_t capacity = 16;
+    while(capacity < vertex_count * 2) capacity *= 2;
+    size_t mask = capacity - 1;
+
+    // Slots hold new vertex index + 1, so that 0 is empty.
+    uint32_t *slots = eng_zalloc(sizeof(*slots) * capacity);
+    uint32_t *remap = eng_zalloc(sizeof(*remap) * vertex_count);
+    size_t welded = 0;
+
+    for(size_t i = 0; i < vertex_count; ++i) {
+        const float *v = &verts[i * stride];
+        size_t slot = hash_vertex(v, stride) & mask;
+
+        for(;; slot = (slot + 1) & mask) {
+            if(!slots[slot]) {
+                // New vertices only ever move down, so this can't overwrite
+                // anything we still have to look at.
+                memmove(&verts[welded * stride], v, sizeof(*verts) * stride);
+                slots[slot] = (uint32_t)(welded + 1);
+                remap[i] = (uint32_t)welded++;
+                break;
+            }
+
+            uint32_t other = slots[slot] - 1;
+            if(!memcmp(&verts[other * stride], v, sizeof(*verts) * stride)) {
+                remap[i] = other;
+                break;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < index_count; ++i) tris[i] = remap[tris[i]];
+
+    eng_free(remap, sizeof(*remap) * vertex_count);
+    eng_free(slots, sizeof(*slots) * capacity);
+    return welded;
+}
+
+// Tipsify. Emits the triangles around one vertex at a time (a fan), then
+// moves on to a vertex of that fan that will still be in the cache after its
+// own remaining triangles are emitted, or else the most recently used vertex
+// that still has triangles (from the dead-end stack), or else the next one in
+// index order.
+static void
+tipsify(uint32_t *tris, size_t index_count, size_t vertex_count) {
+    size_t tri_count = index_count / 3;
+
+    // Triangles around each vertex, as offsets into adjacency.
+    uint32_t *live = eng_zalloc(sizeof(*live) * vertex_count);
+    uint32_t *offset = eng_zalloc(sizeof(*offset) * (vertex_count + 1));
+    uint32_t *adjacency = eng_zalloc(sizeof(*adjacency) * index_count);
+
+    for(size_t i = 0; i < index_count; ++i) live[tris[i]] += 1;
+    for(size_t v = 0; v < vertex_count; ++v) offset[v + 1] = offset[v] + live[v];
+
+    uint32_t *fill = eng_zalloc(sizeof(*fill) * vertex_count);
+    for(size_t i = 0; i < index_count; ++i) {
+        uint32_t v = tris[i];
+        adjacency[offset[v] + fill[v]++] = (uint32_t)(i / 3);
+    }
+    eng_free(fill, sizeof(*fill) * vertex_count);
+
+    size_t *cache_time = eng_zalloc(sizeof(*cache_time) * vertex_count);
+    bool *emitted = eng_zalloc(sizeof(*emitted) * tri_count);
+    uint32_t *dead_end = eng_zalloc(sizeof(*dead_end) * index_count);
+    uint32_t *candidates = eng_zalloc(sizeof(*candidates) * index_count);
+    uint32_t *out = eng_zalloc(sizeof(*out) * index_count);
+
+    size_t dead_end_count = 0;
+    size_t out_count = 0;
+    size_t time = VCACHE_SIZE + 1;
+    size_t cursor = 0;
+
+    long fanning = vertex_count > 0 ? 0 : -1;
+    while(fanning >= 0) {
+        size_t candidate_count = 0;
+
+        for(uint32_t a = offset[fanning]; a < offset[fanning + 1]; ++a) {
+            uint32_t t = adjacency[a];
+            if(emitted[t]) continue;
+
+            for(size_t k = 0; k < 3; ++k) {
+                uint32_t v = tris[t * 3 + k];
+                out[out_count++] = v;
+                dead_end[dead_end_count++] = v;
+                candidates[candidate_count++] = v;
+                live[v] -= 1;
+
+                if(time - cache_time[v] > VCACHE_SIZE) {
+                    cache_time[v] = time++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // Best candidate: the one that has been in the cache longest but will
+        // still be there once its remaining triangles are emitted.
+        long next = -1;
+        long best = -1;
+        for(size_t c = 0; c < candidate_count; ++c) {
+            uint32_t v = candidates[c];
+            if(live[v] == 0) continue;
+
+            long priority = 0;
+            if(time - cache_time[v] + 2 * live[v] <= VCACHE_SIZE) {
+                priority = (long)(time - cache_time[v]);
+            }
+            if(priority > best) {
+                best = priority;
+                next = v;
+            }
+        }
+
+        if(next < 0) {
+            while(dead_end_count > 0) {
+                uint32_t v = dead_end[--dead_end_count];
+                if(live[v] > 0) { next = v; break; }
+            }
+        }
+
+        if(next < 0) {
+            while(cursor < vertex_count && live[cursor] == 0) cursor += 1;
+            if(cursor < vertex_count) next = (long)cursor;
+        }
+
+        fanning = next;
+    }
+
+    assert(out_count == tri_count * 3);
+    memcpy(tris, out, sizeof(*tris) * out_count);
+
+    eng_free(out, sizeof(*out) * index_count);
+    eng_free(candidates, sizeof(*candidates) * index_count);
+    eng_free(dead_end, sizeof(*dead_end) * index_count);
+    eng_free(emitted, sizeof(*emitted) * tri_count);
+    eng_free(cache_time, sizeof(*cache_time) * vertex_count);
+    eng_free(adjacency, sizeof(*adjacency) * index_count);
+    eng_free(offset, sizeof(*offset) * (vertex_count + 1));
+    eng_free(live, sizeof(*live) * vertex_count);
+}
+
+// Renumbers the vertices in the order tris first uses them. Vertices no
+// triangle uses keep their relative order at the end.
+static void
+reorder_vertices_for_fetch(float *verts, size_t stride, size_t vertex_count, uint32_t *tris, size_t index_count) {
+    const uint32_t unseen = UINT32_MAX;
+    uint32_t *remap = eng_zalloc(sizeof(*remap) * vertex_count);
+    for(size_t v = 0; v < vertex_count; ++v) remap[v] = unseen;
+
+    uint32_t next = 0;
+    for(size_t i = 0; i < index_count; ++i) {
+        if(remap[tris[i]] == unseen) remap[tris[i]] = next++;
+        tris[i] = remap[tris[i]];
+    }
+    for(size_t v = 0; v < vertex_count; ++v) {
+        if(remap[v] == unseen) remap[v] = next++;
+    }
+
+    size_t bytes = sizeof(*verts) * stride * vertex_count;
+    float *tmp = eng_zalloc(bytes);
+    for(size_t v = 0; v < vertex_count; ++v) {
+        memcpy(&tmp[remap[v] * stride], &verts[v * stride], sizeof(*verts) * stride);
+    }
+    memcpy(verts, tmp, bytes);
+
+    eng_free(tmp, bytes);
+    eng_free(remap, sizeof(*remap) * vertex_count);
+}
+
+// Runs all of the above on a mesh with stride floats per vertex, and returns
+// its new vertex count.
+static size_t
+optimize_mesh(const char *name, float *verts, size_t stride, size_t vertex_count, uint32_t *tris, size_t index_count) {
+    float acmr_before = mesh_acmr(tris, index_count, vertex_count);
+
+    size_t welded_count = weld_vertices(verts, stride, vertex_count, tris, index_count);
+    tipsify(tris, index_count, welded_count);
+    reorder_vertices_for_fetch(verts, stride, welded_count, tris, index_count);
+
+    float acmr_after = mesh_acmr(tris, index_count, welded_count);
+
+    SDL_Log("model: optimized mesh '%s': %zu -> %zu vertices, ACMR %.3f -> %.3f (%d-entry FIFO)",
+        name, vertex_count, welded_count, acmr_before, acmr_after, VCACHE_SIZE);
+    return welded_count;
+}
+
 void
 convert_to_cglm(mat4 dest, struct aiMatrix4x4 *src) {
     dest[0][0] = src->a1;
@@ -72,8 +435,70 @@ dump_mat(const char *name, mat4 mat) {
     SDL_Log("--------------------");
 }
 
+// Props have no bones, so there's no point carrying weights for them around;
+// they only get what a static_mesh needs.
+static void
+handle_static_mesh(struct aiMesh *mesh, struct import_data *id) {
+    SDL_Log("got static mesh ");
+
+    struct static_mesh *output = NULL;
+    if(id->got_stm < id->num_stm) {
+        output = id->stm[id->got_stm++];
+    }
+    else return;
+
+    SDL_Log("mNumVertices = %u, mNumFaces = %u", mesh->mNumVertices, mesh->mNumFaces);
+
+    size_t vert_arrsize = mesh->mNumVertices * STATIC_MESH_4BYTES_COUNT;
+    size_t elem_arrsize = mesh->mNumFaces * 3; // Triangulated
+
+    float *vert_data = eng_zalloc(sizeof(*vert_data) * vert_arrsize);
+    uint32_t *elem_data = eng_zalloc(sizeof(*elem_data) * elem_arrsize);
+
+    assert(mesh->mVertices);
+    assert(mesh->mNormals);
+
+    for(size_t i = 0; i < mesh->mNumVertices; ++i) {
+        float *v = &vert_data[i * STATIC_MESH_4BYTES_COUNT];
+        v[0] = mesh->mVertices[i].x;
+        v[1] = mesh->mVertices[i].y;
+        v[2] = mesh->mVertices[i].z;
+
+        v[3] = mesh->mNormals[i].x;
+        v[4] = mesh->mNormals[i].y;
+        v[5] = mesh->mNormals[i].z;
+
+        if(mesh->mTextureCoords[0]) {
+            v[6] = mesh->mTextureCoords[0][i].x;
+            v[7] = mesh->mTextureCoords[0][i].y;
+        }
+    }
+
+    for(size_t i = 0; i < mesh->mNumFaces; ++i) {
+        size_t i3 = i * 3;
+        assert(mesh->mFaces[i].mNumIndices == 3);
+        elem_data[i3 + 0] = mesh->mFaces[i].mIndices[0];
+        elem_data[i3 + 1] = mesh->mFaces[i].mIndices[1];
+        elem_data[i3 + 2] = mesh->mFaces[i].mIndices[2];
+    }
+
+    size_t vertex_count = optimize_mesh(mesh->mName.data, vert_data, STATIC_MESH_4BYTES_COUNT,
+        mesh->mNumVertices, elem_data, elem_arrsize);
+
+    stm_init(output, vert_data, vertex_count * STATIC_MESH_4BYTES_COUNT, elem_data, elem_arrsize, output->shader);
+    output->import_key = mesh;
+
+    eng_free(vert_data, sizeof(*vert_data) * vert_arrsize);
+    eng_free(elem_data, sizeof(*elem_data) * elem_arrsize);
+}
+
 void
 handle_mesh(struct aiMesh *mesh, struct import_data *id) {
+    if(!mesh->mBones || mesh->mNumBones == 0) {
+        handle_static_mesh(mesh, id);
+        return;
+    }
+
     SDL_Log("got mesh ");
 
     struct skeletal_mesh *output = NULL;
@@ -139,21 +564,20 @@ handle_mesh(struct aiMesh *mesh, struct import_data *id) {
     }
 
     mat4 *inverse_bind = NULL;
-    mat4 *pose = NULL;
     mat4 *local_pose = NULL;
     int *heirarchy = NULL;
 
     if(mesh->mBones) {
-        struct aiNode **node_map = NULL;
+        struct node_index node_map;
         struct aiNode **tmp_heirarchy = NULL;
 
         SDL_Log("importing bones...");
         inverse_bind = eng_zalloc(sizeof(*inverse_bind) * mesh->mNumBones);
-        pose = eng_zalloc(sizeof(*inverse_bind) * mesh->mNumBones);
         local_pose = eng_zalloc(sizeof(*inverse_bind) * mesh->mNumBones);
         heirarchy = eng_zalloc(sizeof(*heirarchy) * mesh->mNumBones);
 
-        node_map = eng_zalloc(sizeof(*node_map) * mesh->mNumBones);
+        node_index_init(&node_map, mesh->mNumBones);
+        size_t first_mapping = mapping_count;
         tmp_heirarchy = eng_zalloc(sizeof(*tmp_heirarchy) * mesh->mNumBones);
 
         for(size_t i = 0; i < mesh->mNumBones; ++i) {
@@ -161,7 +585,7 @@ handle_mesh(struct aiMesh *mesh, struct import_data *id) {
             
             //SDL_Log("bone: %s - armature node: %s - scene node: %s", bone->mName.data, bone->mArmature->mName.data, bone->mNode->mName.data);
 
-            node_map[i] = bone->mNode;
+            node_index_put(&node_map, bone->mNode, (int)i);
             tmp_heirarchy[i] = bone->mNode->mParent;
             convert_to_cglm(local_pose[i], &bone->mNode->mTransformation);
 
@@ -208,35 +632,32 @@ handle_mesh(struct aiMesh *mesh, struct import_data *id) {
                 continue;
             }
 
-            // Initialize the value to -1, in case the parent is non-NULL but
-            // is another node in the tree (which it probably is.)
+            // This is -1 if the parent is non-NULL but is another node in the
+            // tree (which it probably is.)
             //
             // We could also check against the mArmature probably.
-            heirarchy[i] = -1;
-            for(int parent_idx = 0; parent_idx < mesh->mNumBones; ++parent_idx) {
-                if(parent == node_map[parent_idx]) {
-                    heirarchy[i] = parent_idx;
-                    break;
-                }
-            }
+            heirarchy[i] = node_index_get(&node_map, parent);
         }
 
         eng_free(tmp_heirarchy, sizeof(*tmp_heirarchy) * mesh->mNumBones);
-        eng_free(node_map, sizeof(*node_map) * mesh->mNumBones);
+        node_index_free(&node_map);
+
+        sort_bones_parents_first(mesh->mNumBones, inverse_bind, local_pose, heirarchy,
+            vert_data, mesh->mNumVertices, &mappings[first_mapping]);
     }
 
+    // Welding has to wait for the weights, which are part of what makes two
+    // vertices identical.
+    size_t vertex_count = optimize_mesh(mesh->mName.data, vert_data, SKEL_MESH_4BYTES_COUNT,
+        mesh->mNumVertices, elem_data, elem_arrsize);
+
     // TODO: We should just have a shader (?) that we provide here (?)
-    skm_init(output, vert_data, vert_arrsize, elem_data, elem_arrsize, output->shader);
+    skm_init(output, vert_data, vertex_count * SKEL_MESH_4BYTES_COUNT, elem_data, elem_arrsize, output->shader);
     output->bone_inverse_bind = inverse_bind;
-    output->bone_pose = pose;
     output->bone_local_pose = local_pose;
     output->bone_heirarchy = heirarchy;
     output->bone_count = mesh->mNumBones;
 
-    output->bone_tform_tex_data = eng_zalloc(sizeof(mat4) * mesh->mNumBones);
-
-    output->bone_compute_graph = eng_zalloc(sizeof(*output->bone_compute_graph) * mesh->mNumBones);
-
     output->import_key = mesh;
 }
 
@@ -364,9 +785,6 @@ handle_node(struct aiNode *node, const struct aiScene *scene, struct import_data
     }
 }
 
-GLuint
-upload_embedded_texture(void *buf, size_t size);
-
 void
 handle_texture(struct aiTexture *texture, struct import_data *id) {
     GLuint *output = NULL;
@@ -376,22 +794,39 @@ handle_texture(struct aiTexture *texture, struct import_data *id) {
     else return;
 
     SDL_Log("texture info: %d %d %s %s ", texture->mWidth, texture->mHeight, texture->mFilename.data, texture->achFormatHint);
+
+    if(id->texture_data) {
+        // mHeight == 0 means pcData is the compressed file, mWidth bytes long.
+        if(texture->mHeight != 0) return;
+
+        struct import_texture *data = &id->texture_data[output - id->texture];
+        memcpy(data->format, texture->achFormatHint, sizeof(data->format));
+        data->size = texture->mWidth;
+        data->data = eng_zalloc(data->size);
+        memcpy(data->data, texture->pcData, data->size);
+        return;
+    }
+
     if(!strcmp(texture->achFormatHint, "png")) {
         *output = upload_embedded_texture(texture->pcData, texture->mWidth);
     }
 }
 
-void
-load_model(const char *path, struct import_data *id) {
+static const struct aiScene*
+import_file(const char *path) {
     const struct aiScene *scene = aiImportFile(path, aiProcess_Triangulate | aiProcess_PopulateArmatureData | aiProcess_FlipUVs);
     mapping_count = 0;
     if(!scene) {
         SDL_Log("failed to import scene: %s\n", aiGetErrorString());
-        return;
+        return NULL;
     }
 
     SDL_Log("model: got %d meshes, %d skeletons, %d textures\n", scene->mNumMeshes, scene->mNumSkeletons, scene->mNumTextures);
+    return scene;
+}
 
+static void
+import_scene(const struct aiScene *scene, struct import_data *id) {
     for(size_t i = 0; i < scene->mNumMeshes; ++i) {
         handle_mesh(scene->mMeshes[i], id);
     }
@@ -409,8 +844,68 @@ load_model(const char *path, struct import_data *id) {
     // }
 
    // handle_node(scene->mRootNode, scene, id, 0);
+}
+
+void
+load_model(const char *path, struct import_data *id) {
+    const struct aiScene *scene = import_file(path);
+    if(!scene) return;
+
+    import_scene(scene, id);
 
     SDL_Log("model: imported %s\n", path);
 
     aiReleaseImport(scene);
+}
+
+bool
+bake_model(const char *src_path, const char *dst_path) {
+    const struct aiScene *scene = import_file(src_path);
+    if(!scene) return false;
+
+    // Make room for everything in the scene, so that nothing gets dropped on
+    // the floor. It's up to the game which parts it actually wants.
+    struct import_data id = {
+        .num_skm = scene->mNumMeshes,
+        .num_stm = scene->mNumMeshes,
+        .num_skm_arm_anim = scene->mNumAnimations,
+        .num_texture = scene->mNumTextures,
+    };
+
+    id.skm = eng_zalloc(sizeof(*id.skm) * id.num_skm);
+    for(size_t i = 0; i < id.num_skm; ++i) {
+        id.skm[i] = eng_zalloc(sizeof(*id.skm[i]));
+    }
+
+    id.stm = eng_zalloc(sizeof(*id.stm) * id.num_stm);
+    for(size_t i = 0; i < id.num_stm; ++i) {
+        id.stm[i] = eng_zalloc(sizeof(*id.stm[i]));
+    }
+
+    id.skm_arm_anim = eng_zalloc(sizeof(*id.skm_arm_anim) * id.num_skm_arm_anim);
+    for(size_t i = 0; i < id.num_skm_arm_anim; ++i) {
+        id.skm_arm_anim[i] = eng_zalloc(sizeof(*id.skm_arm_anim[i]));
+    }
+
+    id.texture = eng_zalloc(sizeof(*id.texture) * id.num_texture);
+    id.texture_data = eng_zalloc(sizeof(*id.texture_data) * id.num_texture);
+
+    import_scene(scene, &id);
+    aiReleaseImport(scene);
+
+    bool result = write_baked_model(dst_path, &id);
+    if(result) {
+        SDL_Log("model: baked %s -> %s (%zu skinned meshes, %zu static meshes, %zu animations, %zu textures)",
+            src_path, dst_path, id.got_skm, id.got_stm, id.got_skm_arm_anim, id.got_texture);
+    }
+
+    // This is a one-shot tool path, so we don't bother tearing down the
+    // imported meshes themselves.
+    for(size_t i = 0; i < id.num_texture; ++i) {
+        eng_free(id.texture_data[i].data, id.texture_data[i].size);
+    }
+    eng_free(id.texture_data, sizeof(*id.texture_data) * id.num_texture);
+    eng_free(id.texture, sizeof(*id.texture) * id.num_texture);
+
+    return result;
 }
\ No newline at end of file
@@ -2,12 +2,27 @@
 #define ENG_MODEL_H
 
 #include "skeletal_mesh.h"
+#include "static_mesh.h"
+
+/* An embedded texture, still in its encoded form (e.g. a png file). */
+struct import_texture {
+    char format[9];
+
+    uint8_t *data;
+    size_t size;
+};
 
 struct import_data {
     struct skeletal_mesh **skm;
     size_t num_skm;
     size_t got_skm;
 
+    /* Meshes without bones go here instead of into skm, and only keep
+     * positions, normals and texture coordinates. */
+    struct static_mesh **stm;
+    size_t num_stm;
+    size_t got_stm;
+
     struct skm_armature_anim **skm_arm_anim;
     size_t num_skm_arm_anim;
     size_t got_skm_arm_anim;
@@ -15,6 +30,11 @@ struct import_data {
     GLuint *texture;
     size_t num_texture;
     size_t got_texture;
+
+    /* If non-NULL, embedded textures are copied in here (with the same
+     * indices as texture) instead of being uploaded to GL. Used for baking,
+     * where we don't have a GL context. */
+    struct import_texture *texture_data;
 };
 
 // How many things we put in each vertex.
@@ -22,4 +42,16 @@ struct import_data {
 
 void load_model(const char *path, struct import_data *id);
 
+/**
+ * Decodes an embedded texture (e.g. a png file) and uploads it to GL.
+ * Returns 0 if it couldn't be decoded. Lives in stb_image.c.
+ */
+GLuint upload_embedded_texture(void *buf, size_t size);
+
+/**
+ * Imports the model at src_path with assimp and writes everything in it to
+ * dst_path in the baked format (see baked_model.h). Returns false on failure.
+ */
+bool bake_model(const char *src_path, const char *dst_path);
+
 #endif
\ No newline at end of file
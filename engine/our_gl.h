@@ -9,6 +9,9 @@
 
 #include <SDL3/SDL_log.h>
 
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 static inline const char*
@@ -49,6 +52,42 @@ ourgl_report(const char *file, int lineno, const char *line) {
     }
 }
 
+/* Meshes with at most this many vertices get 16-bit element buffers, which
+ * are half the size, and are all WebGL 1 has without OES_element_index_uint.
+ * Anything bigger has to be split up to get them. */
+#define OURGL_MAX_SHORT_VERTICES 65536
+
+static inline GLenum
+ourgl_index_type(size_t vertex_count) {
+    return vertex_count <= OURGL_MAX_SHORT_VERTICES ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+static inline size_t
+ourgl_index_size(GLenum index_type) {
+    return index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+static inline void
+ourgl_narrow_indices(const uint32_t *indices, size_t count, uint16_t *out) {
+    for(size_t i = 0; i < count; ++i) out[i] = (uint16_t)indices[i];
+}
+
+/* Used by the vertex packers, which clamp everything to what the packed
+ * format can hold. */
+static inline float
+ourgl_clampf(float x, float lo, float hi) {
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+/* Packs a texture coordinate pair into unorm16. Returns false if either was
+ * outside [0, 1] and got clamped, which would be wrong for a tiling texture. */
+static inline bool
+ourgl_pack_uv(const float *uv, uint16_t *out) {
+    out[0] = (uint16_t)lroundf(ourgl_clampf(uv[0], 0.0f, 1.0f) * 65535.0f);
+    out[1] = (uint16_t)lroundf(ourgl_clampf(uv[1], 0.0f, 1.0f) * 65535.0f);
+    return uv[0] >= 0.0f && uv[0] <= 1.0f && uv[1] >= 0.0f && uv[1] <= 1.0f;
+}
+
 #ifdef FAST_MODE
 #define REPORT(...) __VA_ARGS__
 
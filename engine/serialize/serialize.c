@@ -2,14 +2,118 @@
 
 #include <string.h>
 #include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "engine/alloc.h"
 
 // Serialize everything as little-endian, so that in theory the compiler could
 // optimize stuff.
 
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_WIN32)
+#define HOST_IS_LITTLE_ENDIAN 1
+#else
+#define HOST_IS_LITTLE_ENDIAN 0
+#endif
+
+static void
+put_bytes(struct serializer *s, uint8_t *bytes, size_t count) {
+    s->write_bytes(s, bytes, count);
+    s->position += count;
+}
+
+static void
+get_bytes(struct deserializer *d, uint8_t *bytes, size_t count) {
+    d->read_bytes(d, bytes, count);
+    d->position += count;
+}
+
+// Arrays of multi-byte values are padded so that their first element is
+// aligned to its own size, relative to the start of the data. This is what
+// lets a mapped file hand out pointers to them directly.
+static size_t
+padding_for(uint64_t position, size_t align) {
+    return (size_t)((align - (position % align)) % align);
+}
+
+// Converts count elements of elem_size bytes between little- and big-endian.
+// src and dst may be the same buffer. Each size gets its own fixed-width loop
+// so that the compiler can vectorize it.
+static void
+swap_bytes(uint8_t *dst, const uint8_t *src, size_t elem_size, size_t count) {
+    switch(elem_size) {
+    case 2:
+        for(size_t i = 0; i < count; ++i) {
+            uint8_t a = src[i * 2 + 0], b = src[i * 2 + 1];
+            dst[i * 2 + 0] = b;
+            dst[i * 2 + 1] = a;
+        }
+        break;
+    case 4:
+        for(size_t i = 0; i < count; ++i) {
+            uint8_t e[4];
+            memcpy(e, src + i * 4, 4);
+            for(size_t b = 0; b < 4; ++b) dst[i * 4 + b] = e[3 - b];
+        }
+        break;
+    case 8:
+        for(size_t i = 0; i < count; ++i) {
+            uint8_t e[8];
+            memcpy(e, src + i * 8, 8);
+            for(size_t b = 0; b < 8; ++b) dst[i * 8 + b] = e[7 - b];
+        }
+        break;
+    default:
+        if(dst != src) memcpy(dst, src, elem_size * count);
+        break;
+    }
+}
+
+// Writes the elements of a typed array. On little-endian hosts the memory
+// layout already is the wire format, so the whole block goes out in one call;
+// otherwise it is swapped a chunk at a time.
+static void
+write_elements(struct serializer *s, const void *values, size_t elem_size, size_t count) {
+    const uint8_t *src = values;
+    if(HOST_IS_LITTLE_ENDIAN || elem_size == 1) {
+        put_bytes(s, (uint8_t*)src, elem_size * count);
+        return;
+    }
+
+    uint8_t chunk[4096];
+    size_t per_chunk = sizeof(chunk) / elem_size;
+    while(count > 0) {
+        size_t n = count < per_chunk ? count : per_chunk;
+        swap_bytes(chunk, src, elem_size, n);
+        put_bytes(s, chunk, elem_size * n);
+        src += elem_size * n;
+        count -= n;
+    }
+}
+
+static void
+write_padding(struct serializer *s, size_t align) {
+    uint8_t zeroes[8] = {0};
+    put_bytes(s, zeroes, padding_for(s->position, align));
+}
+
+static void
+skip_padding(struct deserializer *d, size_t align) {
+    uint8_t skipped[8];
+    get_bytes(d, skipped, padding_for(d->position, align));
+}
+
 void
 write_u8(struct serializer *s, uint8_t value) {
     s->write_byte(s, value);
+    s->position += 1;
 }
 
 void
@@ -17,7 +121,7 @@ write_u16(struct serializer *s, uint16_t value) {
     uint8_t bytes[2];
     bytes[0] = (uint8_t)((value >> 0) & 0xFF);
     bytes[1] = (uint8_t)((value >> 8) & 0xFF);
-    s->write_bytes(s, bytes, 2);
+    put_bytes(s, bytes, 2);
 }
 
 void
@@ -27,7 +131,7 @@ write_u32(struct serializer *s, uint32_t value) {
     bytes[1] = (uint8_t)((value >>  8) & 0xFF);
     bytes[2] = (uint8_t)((value >> 16) & 0xFF);
     bytes[3] = (uint8_t)((value >> 24) & 0xFF);
-    s->write_bytes(s, bytes, 4);
+    put_bytes(s, bytes, 4);
 }
 
 void
@@ -41,7 +145,7 @@ write_u64(struct serializer *s, uint64_t value) {
     bytes[5] = (uint8_t)((value >> 40) & 0xFF);
     bytes[6] = (uint8_t)((value >> 48) & 0xFF);
     bytes[7] = (uint8_t)((value >> 56) & 0xFF);
-    s->write_bytes(s, bytes, 8);
+    put_bytes(s, bytes, 8);
 }
 
 void
@@ -90,7 +194,8 @@ write_double(struct serializer *s, double value) {
 void \
 write_ ## sname ## _array (struct serializer *s, size_t length, datatype *values) { \
     write_u64(s, (uint64_t)length); \
-    for(size_t i = 0; i < length; ++i) { write_ ## sname (s, values[i]); } \
+    write_padding(s, sizeof(datatype)); \
+    write_elements(s, values, sizeof(datatype), length); \
 }
 
 IMPL_WRITE_ARRAY(u8, uint8_t)
@@ -116,28 +221,190 @@ write_array(struct serializer *s, size_t length, void *array, size_t stride, voi
     }
 }
 
+uint8_t
+read_u8(struct deserializer *d) {
+    d->position += 1;
+    return d->read_byte(d);
+}
+
+uint16_t
+read_u16(struct deserializer *d) {
+    uint8_t bytes[2];
+    get_bytes(d, bytes, 2);
+    return (uint16_t)bytes[0]
+        | ((uint16_t)bytes[1] << 8);
+}
+
+uint32_t
+read_u32(struct deserializer *d) {
+    uint8_t bytes[4];
+    get_bytes(d, bytes, 4);
+    return ((uint32_t)bytes[0] <<  0)
+        | ((uint32_t)bytes[1] <<  8)
+        | ((uint32_t)bytes[2] << 16)
+        | ((uint32_t)bytes[3] << 24);
+}
+
+uint64_t
+read_u64(struct deserializer *d) {
+    uint8_t bytes[8];
+    get_bytes(d, bytes, 8);
+    return ((uint64_t)bytes[0] <<  0)
+        | ((uint64_t)bytes[1] <<  8)
+        | ((uint64_t)bytes[2] << 16)
+        | ((uint64_t)bytes[3] << 24)
+        | ((uint64_t)bytes[4] << 32)
+        | ((uint64_t)bytes[5] << 40)
+        | ((uint64_t)bytes[6] << 48)
+        | ((uint64_t)bytes[7] << 56);
+}
+
+int8_t
+read_i8(struct deserializer *d) {
+    uint8_t byte = read_u8(d);
+    int8_t value;
+    memcpy(&value, &byte, sizeof(value));
+    return value;
+}
+
+int16_t
+read_i16(struct deserializer *d) {
+    uint16_t uvalue = read_u16(d);
+    int16_t value;
+    memcpy(&value, &uvalue, sizeof(value));
+    return value;
+}
+
+int32_t
+read_i32(struct deserializer *d) {
+    uint32_t uvalue = read_u32(d);
+    int32_t value;
+    memcpy(&value, &uvalue, sizeof(value));
+    return value;
+}
+
+int64_t
+read_i64(struct deserializer *d) {
+    uint64_t uvalue = read_u64(d);
+    int64_t value;
+    memcpy(&value, &uvalue, sizeof(value));
+    return value;
+}
+
+float
+read_float(struct deserializer *d) {
+    uint32_t uvalue = read_u32(d);
+    float value;
+    memcpy(&value, &uvalue, sizeof(value));
+    return value;
+}
+
+double
+read_double(struct deserializer *d) {
+    uint64_t uvalue = read_u64(d);
+    double value;
+    memcpy(&value, &uvalue, sizeof(value));
+    return value;
+}
+
+// Arrays are read with a single read_bytes, then swapped in place if the host
+// is big-endian.
+static void*
+read_elements(struct deserializer *d, size_t elem_size, size_t count) {
+    uint8_t *values = eng_zalloc(elem_size * count);
+    get_bytes(d, values, elem_size * count);
+    if(!HOST_IS_LITTLE_ENDIAN) swap_bytes(values, values, elem_size, count);
+    return values;
+}
+
+#define IMPL_READ_ARRAY(sname, datatype) \
+datatype* \
+read_ ## sname ## _array (struct deserializer *d, size_t *length) { \
+    *length = (size_t)read_u64(d); \
+    skip_padding(d, sizeof(datatype)); \
+    if(d->failed || *length == 0) { *length = 0; return NULL; } \
+    return read_elements(d, sizeof(datatype), *length); \
+} \
+\
+datatype* \
+view_ ## sname ## _array (struct deserializer *d, size_t *length, bool *owned) { \
+    *owned = true; \
+    *length = (size_t)read_u64(d); \
+    skip_padding(d, sizeof(datatype)); \
+    if(d->failed || *length == 0) { *length = 0; return NULL; } \
+    if(HOST_IS_LITTLE_ENDIAN && d->view_bytes) { \
+        size_t bytes = sizeof(datatype) * *length; \
+        uint8_t *view = d->view_bytes(d, bytes); \
+        if(view && ((uintptr_t)view % sizeof(datatype)) == 0) { \
+            d->position += bytes; \
+            *owned = false; \
+            return (datatype*)view; \
+        } \
+        if(view) { \
+            /* Misaligned, e.g. data written before we padded arrays. */ \
+            d->position += bytes; \
+            datatype *values = eng_zalloc(bytes); \
+            memcpy(values, view, bytes); \
+            return values; \
+        } \
+    } \
+    return read_elements(d, sizeof(datatype), *length); \
+}
+
+IMPL_READ_ARRAY(u8, uint8_t)
+IMPL_READ_ARRAY(u16, uint16_t)
+IMPL_READ_ARRAY(u32, uint32_t)
+IMPL_READ_ARRAY(u64, uint64_t)
+
+IMPL_READ_ARRAY(i8, int8_t)
+IMPL_READ_ARRAY(i16, int16_t)
+IMPL_READ_ARRAY(i32, int32_t)
+IMPL_READ_ARRAY(i64, int64_t)
+
+IMPL_READ_ARRAY(float, float)
+IMPL_READ_ARRAY(double, double)
+
+void*
+read_array(struct deserializer *d, size_t *length, size_t stride, void (*read_element)(struct deserializer*, void*)) {
+    *length = (size_t)read_u64(d);
+    if(d->failed || *length == 0) { *length = 0; return NULL; }
+
+    char *ptr = eng_zalloc(stride * *length);
+    for(size_t i = 0; i < *length; ++i) {
+        char *elemstart = ptr + stride * i;
+        read_element(d, elemstart);
+    }
+    return ptr;
+}
+
 struct stdio_writer {
     struct serializer serial;
     FILE *file;
 };
 
 void
-stdio_write_byte(void *self, uint8_t byte) {
+stdio_write_bytes(void *self, uint8_t *bytes, size_t count) {
     struct stdio_writer *w = self;
-    fwrite(&byte, 1, 1, w->file);
+    if(w->serial.failed) return;
+    if(fwrite(bytes, 1, count, w->file) != count) w->serial.failed = true;
 }
 
 void
-stdio_write_bytes(void *self, uint8_t *bytes, size_t count) {
-    struct stdio_writer *w = self;
-    fwrite(bytes, 1, count, w->file);
+stdio_write_byte(void *self, uint8_t byte) {
+    stdio_write_bytes(self, &byte, 1);
+}
+
+static bool
+stdio_close_write(void *self) {
+    return close_stdio_write(self);
 }
 
 struct serializer*
 get_stdio_writer(const char *path) {
     struct stdio_writer *writer = eng_zalloc(sizeof(*writer));
 
-    writer->file = fopen(path, "w");
+    // Binary mode, or Windows will helpfully translate our newlines.
+    writer->file = fopen(path, "wb");
     if(!writer->file) {
         eng_free(writer, sizeof(*writer));
         return NULL;
@@ -145,18 +412,369 @@ get_stdio_writer(const char *path) {
 
     writer->serial.write_byte = stdio_write_byte;
     writer->serial.write_bytes = stdio_write_bytes;
-    
+    writer->serial.close = stdio_close_write;
+
     return &writer->serial;
 }
 
-void
+bool
 close_stdio_write(struct serializer *s) {
-    if(!s) return;
+    if(!s) return false;
 
     struct stdio_writer *writer = (struct stdio_writer*)s;
 
-    fclose(writer->file);
+    // fclose flushes stdio's own buffer, so it can fail too.
+    bool ok = !writer->serial.failed;
+    if(fclose(writer->file) != 0) ok = false;
     writer->file = NULL;
 
     eng_free(writer, sizeof(*writer));
-}
\ No newline at end of file
+    return ok;
+}
+
+#define MEMORY_WRITER_INITIAL_SIZE (64 * 1024)
+
+struct memory_writer {
+    struct serializer serial;
+
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+};
+
+void
+memory_write_bytes(void *self, uint8_t *bytes, size_t count) {
+    struct memory_writer *w = self;
+
+    if(count > w->capacity - w->size) {
+        size_t capacity = w->capacity;
+        while(count > capacity - w->size) capacity *= 2;
+
+        uint8_t *data = eng_zalloc(capacity);
+        memcpy(data, w->data, w->size);
+        eng_free(w->data, w->capacity);
+
+        w->data = data;
+        w->capacity = capacity;
+    }
+
+    memcpy(w->data + w->size, bytes, count);
+    w->size += count;
+}
+
+void
+memory_write_byte(void *self, uint8_t byte) {
+    struct memory_writer *w = self;
+    if(w->size < w->capacity) {
+        w->data[w->size++] = byte;
+        return;
+    }
+    memory_write_bytes(self, &byte, 1);
+}
+
+static bool
+memory_close_write(void *self) {
+    struct memory_writer *w = self;
+    eng_free(w->data, w->capacity);
+    eng_free(w, sizeof(*w));
+    return true;
+}
+
+struct serializer*
+get_memory_writer(void) {
+    struct memory_writer *writer = eng_zalloc(sizeof(*writer));
+
+    writer->capacity = MEMORY_WRITER_INITIAL_SIZE;
+    writer->data = eng_zalloc(writer->capacity);
+
+    writer->serial.write_byte = memory_write_byte;
+    writer->serial.write_bytes = memory_write_bytes;
+    writer->serial.close = memory_close_write;
+
+    return &writer->serial;
+}
+
+uint8_t*
+memory_writer_data(struct serializer *s, size_t *size) {
+    struct memory_writer *writer = (struct memory_writer*)s;
+    *size = writer->size;
+    return writer->data;
+}
+
+#define BUFFERED_WRITER_SIZE (64 * 1024)
+
+struct buffered_writer {
+    struct serializer serial;
+    struct serializer *inner;
+
+    uint8_t buffer[BUFFERED_WRITER_SIZE];
+    size_t size;
+};
+
+static void
+buffered_flush(struct buffered_writer *w) {
+    if(w->size > 0) w->inner->write_bytes(w->inner, w->buffer, w->size);
+    w->size = 0;
+    if(w->inner->failed) w->serial.failed = true;
+}
+
+void
+buffered_write_bytes(void *self, uint8_t *bytes, size_t count) {
+    struct buffered_writer *w = self;
+
+    if(count > BUFFERED_WRITER_SIZE - w->size) {
+        buffered_flush(w);
+
+        // Big writes go straight through.
+        if(count >= BUFFERED_WRITER_SIZE) {
+            w->inner->write_bytes(w->inner, bytes, count);
+            if(w->inner->failed) w->serial.failed = true;
+            return;
+        }
+    }
+
+    memcpy(w->buffer + w->size, bytes, count);
+    w->size += count;
+}
+
+void
+buffered_write_byte(void *self, uint8_t byte) {
+    struct buffered_writer *w = self;
+    if(w->size == BUFFERED_WRITER_SIZE) buffered_flush(w);
+    w->buffer[w->size++] = byte;
+}
+
+static bool
+buffered_close_write(void *self) {
+    struct buffered_writer *w = self;
+    buffered_flush(w);
+    bool ok = !w->serial.failed;
+    if(!close_writer(w->inner)) ok = false;
+    eng_free(w, sizeof(*w));
+    return ok;
+}
+
+struct serializer*
+get_buffered_writer(struct serializer *inner) {
+    if(!inner) return NULL;
+
+    struct buffered_writer *writer = eng_zalloc(sizeof(*writer));
+    writer->inner = inner;
+
+    writer->serial.write_byte = buffered_write_byte;
+    writer->serial.write_bytes = buffered_write_bytes;
+    writer->serial.close = buffered_close_write;
+
+    return &writer->serial;
+}
+
+bool
+close_writer(struct serializer *s) {
+    if(!s) return false;
+    return s->close(s);
+}
+
+#define STDIO_READER_BUFFER_SIZE (64 * 1024)
+
+struct stdio_reader {
+    struct deserializer deserial;
+    FILE *file;
+
+    uint8_t buffer[STDIO_READER_BUFFER_SIZE];
+    size_t buffer_pos;
+    size_t buffer_len;
+};
+
+void
+stdio_read_bytes(void *self, uint8_t *bytes, size_t count) {
+    struct stdio_reader *r = self;
+
+    while(count > 0 && !r->deserial.failed) {
+        if(r->buffer_pos == r->buffer_len) {
+            // Big reads go straight into the destination.
+            if(count >= STDIO_READER_BUFFER_SIZE) {
+                if(fread(bytes, 1, count, r->file) != count) break;
+                return;
+            }
+
+            r->buffer_pos = 0;
+            r->buffer_len = fread(r->buffer, 1, STDIO_READER_BUFFER_SIZE, r->file);
+            if(r->buffer_len == 0) break;
+        }
+
+        size_t chunk = r->buffer_len - r->buffer_pos;
+        if(chunk > count) chunk = count;
+
+        memcpy(bytes, r->buffer + r->buffer_pos, chunk);
+        r->buffer_pos += chunk;
+        bytes += chunk;
+        count -= chunk;
+    }
+
+    if(count > 0) {
+        r->deserial.failed = true;
+        memset(bytes, 0, count);
+    }
+}
+
+uint8_t
+stdio_read_byte(void *self) {
+    struct stdio_reader *r = self;
+    if(r->buffer_pos < r->buffer_len) {
+        return r->buffer[r->buffer_pos++];
+    }
+
+    uint8_t byte = 0;
+    stdio_read_bytes(self, &byte, 1);
+    return byte;
+}
+
+void
+close_stdio_read(struct deserializer *d) {
+    if(!d) return;
+
+    struct stdio_reader *reader = (struct stdio_reader*)d;
+
+    fclose(reader->file);
+    reader->file = NULL;
+
+    eng_free(reader, sizeof(*reader));
+}
+
+static void
+stdio_close(void *self) {
+    close_stdio_read(self);
+}
+
+struct deserializer*
+get_stdio_reader(const char *path) {
+    struct stdio_reader *reader = eng_zalloc(sizeof(*reader));
+
+    reader->file = fopen(path, "rb");
+    if(!reader->file) {
+        eng_free(reader, sizeof(*reader));
+        return NULL;
+    }
+
+    reader->deserial.read_byte = stdio_read_byte;
+    reader->deserial.read_bytes = stdio_read_bytes;
+    reader->deserial.close = stdio_close;
+
+    return &reader->deserial;
+}
+
+struct mmap_reader {
+    struct deserializer deserial;
+
+    uint8_t *data;
+    size_t size;
+    size_t pos;
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+void
+mmap_read_bytes(void *self, uint8_t *bytes, size_t count) {
+    struct mmap_reader *r = self;
+    if(r->deserial.failed || count > r->size - r->pos) {
+        r->deserial.failed = true;
+        memset(bytes, 0, count);
+        return;
+    }
+
+    memcpy(bytes, r->data + r->pos, count);
+    r->pos += count;
+}
+
+uint8_t
+mmap_read_byte(void *self) {
+    uint8_t byte = 0;
+    mmap_read_bytes(self, &byte, 1);
+    return byte;
+}
+
+uint8_t*
+mmap_view_bytes(void *self, size_t count) {
+    struct mmap_reader *r = self;
+    if(r->deserial.failed || count > r->size - r->pos) {
+        r->deserial.failed = true;
+        return NULL;
+    }
+
+    uint8_t *view = r->data + r->pos;
+    r->pos += count;
+    return view;
+}
+
+static void
+mmap_close(void *self) {
+    struct mmap_reader *r = self;
+
+#ifdef _WIN32
+    if(r->data) UnmapViewOfFile(r->data);
+    if(r->mapping) CloseHandle(r->mapping);
+    if(r->file != INVALID_HANDLE_VALUE) CloseHandle(r->file);
+#else
+    if(r->data) munmap(r->data, r->size);
+#endif
+
+    eng_free(r, sizeof(*r));
+}
+
+struct deserializer*
+get_mmap_reader(const char *path) {
+    struct mmap_reader *reader = eng_zalloc(sizeof(*reader));
+
+    // The mappings are copy-on-write, so that views can be modified in place
+    // without touching the file.
+#ifdef _WIN32
+    reader->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(reader->file == INVALID_HANDLE_VALUE) goto fail;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(reader->file, &size)) goto fail;
+    reader->size = (size_t)size.QuadPart;
+
+    if(reader->size > 0) {
+        reader->mapping = CreateFileMappingA(reader->file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if(!reader->mapping) goto fail;
+
+        reader->data = MapViewOfFile(reader->mapping, FILE_MAP_COPY, 0, 0, 0);
+        if(!reader->data) goto fail;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) goto fail;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0) { close(fd); goto fail; }
+    reader->size = (size_t)st.st_size;
+
+    if(reader->size > 0) {
+        void *data = mmap(NULL, reader->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED) { close(fd); goto fail; }
+        reader->data = data;
+    }
+    close(fd);
+#endif
+
+    reader->deserial.read_byte = mmap_read_byte;
+    reader->deserial.read_bytes = mmap_read_bytes;
+    reader->deserial.view_bytes = mmap_view_bytes;
+    reader->deserial.close = mmap_close;
+
+    return &reader->deserial;
+
+fail:
+    mmap_close(reader);
+    return NULL;
+}
+
+void
+close_reader(struct deserializer *d) {
+    if(!d) return;
+    d->close(d);
+}
@@ -6,15 +6,90 @@
 struct serializer {
     void (*write_byte)(void *self, uint8_t value);
     void (*write_bytes)(void *self, uint8_t *values, size_t count);
+
+    /* Returns false if the writer failed at any point, including while
+     * flushing or closing. */
+    bool (*close)(void *self);
+
+    /* How many bytes have been written so far. Kept up to date by the
+     * write_* functions, not the backends. */
+    uint64_t position;
+
+    /* Set by the backend when a write doesn't make it out (a short fwrite,
+     * a full disk, ...). Writes after that are dropped, so callers only need
+     * to check once, through close_writer. */
+    bool failed;
 };
 
 struct deserializer {
-    void (*read_byte)(void *self, uint8_t value);
+    uint8_t (*read_byte)(void *self);
     void (*read_bytes)(void *self, uint8_t *values, size_t count);
+
+    /* Optional. Returns a pointer to the next count bytes of the backend's
+     * own storage and skips past them, or NULL if it can't. The memory must
+     * stay valid (and writable) until the deserializer is closed. */
+    uint8_t* (*view_bytes)(void *self, size_t count);
+
+    void (*close)(void *self);
+
+    /* How many bytes have been read so far. Kept up to date by the read_*
+     * functions, not the backends. */
+    uint64_t position;
+
+    /* Set by the backend when a read runs past the end of the data. Reads
+     * after that return zeroes, so callers only need to check it once when
+     * they're done. */
+    bool failed;
 };
 
 struct serializer* get_stdio_writer(const char *path);
-void close_stdio_write(struct serializer *s);
+bool close_stdio_write(struct serializer *s);
+
+/**
+ * Writes into a growable in-memory arena. Use memory_writer_data to get at
+ * the result before closing it.
+ */
+struct serializer* get_memory_writer(void);
+
+/**
+ * Returns the bytes written to a memory writer so far. The pointer is valid
+ * until the next write or until the writer is closed.
+ */
+uint8_t* memory_writer_data(struct serializer *s, size_t *size);
+
+/**
+ * Collects writes in a buffer in front of another serializer, and only passes
+ * them on in large blocks (and at close). Closing it also closes inner.
+ * Returns NULL if inner is NULL, so that it can wrap get_*_writer directly.
+ */
+struct serializer* get_buffered_writer(struct serializer *inner);
+
+/**
+ * Closes any kind of serializer, flushing whatever it still has buffered.
+ * Returns false if anything written to it didn't make it out.
+ */
+bool close_writer(struct serializer *s);
+
+/**
+ * Reads a file through our own buffer, so that small reads don't each turn
+ * into a libc call.
+ */
+struct deserializer* get_stdio_reader(const char *path);
+
+/**
+ * Maps a whole file into memory. Supports the view_*_array functions, which
+ * can then hand out pointers straight into the file. Returns NULL if the file
+ * can't be mapped on this platform, in which case use get_stdio_reader.
+ */
+struct deserializer* get_mmap_reader(const char *path);
+
+/**
+ * Closes any kind of deserializer.
+ */
+void close_reader(struct deserializer *d);
+
+/* Kept for symmetry with close_stdio_write. */
+void close_stdio_read(struct deserializer *d);
 
 void write_u8(struct serializer *s, uint8_t value);
 void write_u16(struct serializer *s, uint16_t value);
@@ -44,4 +119,52 @@ void write_double_array(struct serializer *s, size_t length, double *values);
 
 void write_array(struct serializer *s, size_t length, void *array, size_t stride, void (*write_element)(struct serializer*, void*));
 
+uint8_t  read_u8(struct deserializer *d);
+uint16_t read_u16(struct deserializer *d);
+uint32_t read_u32(struct deserializer *d);
+uint64_t read_u64(struct deserializer *d);
+
+int8_t  read_i8(struct deserializer *d);
+int16_t read_i16(struct deserializer *d);
+int32_t read_i32(struct deserializer *d);
+int64_t read_i64(struct deserializer *d);
+
+float  read_float(struct deserializer *d);
+double read_double(struct deserializer *d);
+
+/* The array readers allocate the result with eng_zalloc and store the element
+ * count in *length. They return NULL for empty arrays or on failure. */
+uint8_t*  read_u8_array(struct deserializer *d, size_t *length);
+uint16_t* read_u16_array(struct deserializer *d, size_t *length);
+uint32_t* read_u32_array(struct deserializer *d, size_t *length);
+uint64_t* read_u64_array(struct deserializer *d, size_t *length);
+
+int8_t*  read_i8_array(struct deserializer *d, size_t *length);
+int16_t* read_i16_array(struct deserializer *d, size_t *length);
+int32_t* read_i32_array(struct deserializer *d, size_t *length);
+int64_t* read_i64_array(struct deserializer *d, size_t *length);
+
+float*  read_float_array(struct deserializer *d, size_t *length);
+double* read_double_array(struct deserializer *d, size_t *length);
+
+void* read_array(struct deserializer *d, size_t *length, size_t stride, void (*read_element)(struct deserializer*, void*));
+
+/* Zero-copy versions of the array readers. When the deserializer supports
+ * views (see get_mmap_reader) and the host is little-endian, the result points
+ * directly into the deserializer's data and is only valid until it is closed.
+ * Otherwise it is allocated like read_*_array would. *owned says which, i.e.
+ * whether the caller has to eng_free the result. */
+uint8_t*  view_u8_array(struct deserializer *d, size_t *length, bool *owned);
+uint16_t* view_u16_array(struct deserializer *d, size_t *length, bool *owned);
+uint32_t* view_u32_array(struct deserializer *d, size_t *length, bool *owned);
+uint64_t* view_u64_array(struct deserializer *d, size_t *length, bool *owned);
+
+int8_t*  view_i8_array(struct deserializer *d, size_t *length, bool *owned);
+int16_t* view_i16_array(struct deserializer *d, size_t *length, bool *owned);
+int32_t* view_i32_array(struct deserializer *d, size_t *length, bool *owned);
+int64_t* view_i64_array(struct deserializer *d, size_t *length, bool *owned);
+
+float*  view_float_array(struct deserializer *d, size_t *length, bool *owned);
+double* view_double_array(struct deserializer *d, size_t *length, bool *owned);
+
 #endif
\ No newline at end of file
@@ -4,7 +4,42 @@
 #include "engine/skeletal_mesh.h"
 #include "engine/serialize/serialize.h"
 
+/* Every mesh and animation record starts with its own version, so that the
+ * readers can reject (rather than misread) records from older writers. Bump
+ * these whenever the corresponding write function changes. */
+#define SKM_RECORD_VERSION      1
+#define SKM_ANIM_RECORD_VERSION 1
+
+/**
+ * Writes the vertices, triangles and bones (inverse bind matrices, local
+ * pose and hierarchy) of a mesh.
+ */
 void
 write_skm(struct serializer *s, struct skeletal_mesh *skm);
 
-#endif
\ No newline at end of file
+/**
+ * Reads a mesh written by write_skm into skm. The GL state is not created;
+ * call skm_gl_init afterwards as usual. Returns false if the data was
+ * truncated or written by a different version of write_skm, in which case
+ * nothing read so far is kept and the arrays in skm are NULL.
+ */
+bool
+read_skm(struct deserializer *d, struct skeletal_mesh *skm);
+
+/**
+ * Writes the keys of an animation. The skeletal mesh it belongs to is not
+ * written, the caller has to keep track of that.
+ */
+void
+write_skm_anim(struct serializer *s, struct skm_armature_anim *anim);
+
+/**
+ * Reads an animation written by write_skm_anim, attaching it to skm. Returns
+ * false if the data was truncated, written by a different version of
+ * write_skm_anim, or doesn't match skm's bone count. On failure no keys are
+ * kept and anim->bones is NULL.
+ */
+bool
+read_skm_anim(struct deserializer *d, struct skm_armature_anim *anim, struct skeletal_mesh *skm);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef ENGINE_SERIALIZE_STM_H
+#define ENGINE_SERIALIZE_STM_H
+
+#include "engine/static_mesh.h"
+#include "engine/serialize/serialize.h"
+
+/* Like the skeletal mesh records, bump this whenever write_stm changes. */
+#define STM_RECORD_VERSION 1
+
+/**
+ * Writes the vertices and triangles of a static mesh.
+ */
+void
+write_stm(struct serializer *s, struct static_mesh *stm);
+
+/**
+ * Reads a mesh written by write_stm into stm. The GL state is not created;
+ * call stm_gl_init afterwards as usual. Returns false if the data was
+ * truncated or written by a different version of write_stm, in which case
+ * nothing read so far is kept and the arrays in stm are NULL.
+ */
+bool
+read_stm(struct deserializer *d, struct static_mesh *stm);
+
+#endif
@@ -1,7 +1,170 @@
 #include "engine/serialize/serialize_skm.h"
 
+#include "engine/alloc.h"
+
 void
 write_skm(struct serializer *s, struct skeletal_mesh *skm) {
+    write_u32(s, SKM_RECORD_VERSION);
+
     write_float_array(s, skm->vertices_count, skm->vertices);
     write_u32_array(s, skm->triangles_count, skm->triangles);
-}
\ No newline at end of file
+
+    // Matrices are written as flat arrays of floats, column by column, which
+    // is exactly how cglm lays them out.
+    write_u32(s, (uint32_t)skm->bone_count);
+    write_float_array(s, skm->bone_count * 16, (float*)skm->bone_inverse_bind);
+    write_float_array(s, skm->bone_count * 16, (float*)skm->bone_local_pose);
+    write_i32_array(s, skm->bone_count, skm->bone_heirarchy);
+}
+
+// Each array is freed with the length it was read with, since a failed read
+// can leave them disagreeing with bone_count.
+static void
+free_partial_skm(struct skeletal_mesh *skm, size_t inverse_bind_count, size_t local_pose_count, size_t heirarchy_count) {
+    eng_free(skm->vertices, sizeof(*skm->vertices) * skm->vertices_count);
+    eng_free(skm->triangles, sizeof(*skm->triangles) * skm->triangles_count);
+    eng_free(skm->bone_inverse_bind, sizeof(float) * inverse_bind_count);
+    eng_free(skm->bone_local_pose, sizeof(float) * local_pose_count);
+    eng_free(skm->bone_heirarchy, sizeof(*skm->bone_heirarchy) * heirarchy_count);
+
+    skm->vertices = NULL;
+    skm->triangles = NULL;
+    skm->bone_inverse_bind = NULL;
+    skm->bone_local_pose = NULL;
+    skm->bone_heirarchy = NULL;
+    skm->vertices_count = 0;
+    skm->triangles_count = 0;
+    skm->bone_count = 0;
+}
+
+bool
+read_skm(struct deserializer *d, struct skeletal_mesh *skm) {
+    uint32_t version = read_u32(d);
+    if(d->failed || version != SKM_RECORD_VERSION) {
+        SDL_Log("read_skm: unsupported mesh record version %u", version);
+        return false;
+    }
+
+    skm->vertices = read_float_array(d, &skm->vertices_count);
+    skm->triangles = read_u32_array(d, &skm->triangles_count);
+
+    skm->bone_count = read_u32(d);
+
+    size_t inverse_bind_count, local_pose_count, heirarchy_count;
+    skm->bone_inverse_bind = (mat4*)read_float_array(d, &inverse_bind_count);
+    skm->bone_local_pose = (mat4*)read_float_array(d, &local_pose_count);
+    skm->bone_heirarchy = read_i32_array(d, &heirarchy_count);
+
+    if(d->failed
+        || inverse_bind_count != skm->bone_count * 16
+        || local_pose_count != skm->bone_count * 16
+        || heirarchy_count != skm->bone_count) {
+        free_partial_skm(skm, inverse_bind_count, local_pose_count, heirarchy_count);
+        return false;
+    }
+
+    // skm_compute_matrices relies on parents coming first.
+    for(size_t i = 0; i < skm->bone_count; ++i) {
+        if(skm->bone_heirarchy[i] >= (int32_t)i) {
+            SDL_Log("read_skm: bones are not sorted parents first, please re-bake");
+            free_partial_skm(skm, inverse_bind_count, local_pose_count, heirarchy_count);
+            return false;
+        }
+    }
+
+    skm->array_buf = 0;
+    skm->import_key = NULL;
+
+    return true;
+}
+
+static void
+write_vec3_key(struct serializer *s, void *elem) {
+    struct skm_vec3_key *key = elem;
+    write_float(s, key->time);
+    write_float(s, key->value[0]);
+    write_float(s, key->value[1]);
+    write_float(s, key->value[2]);
+}
+
+static void
+write_quat_key(struct serializer *s, void *elem) {
+    struct skm_quat_key *key = elem;
+    write_float(s, key->time);
+    write_float(s, key->value[0]);
+    write_float(s, key->value[1]);
+    write_float(s, key->value[2]);
+    write_float(s, key->value[3]);
+}
+
+static void
+read_vec3_key(struct deserializer *d, void *elem) {
+    struct skm_vec3_key *key = elem;
+    key->time = read_float(d);
+    key->value[0] = read_float(d);
+    key->value[1] = read_float(d);
+    key->value[2] = read_float(d);
+}
+
+static void
+read_quat_key(struct deserializer *d, void *elem) {
+    struct skm_quat_key *key = elem;
+    key->time = read_float(d);
+    key->value[0] = read_float(d);
+    key->value[1] = read_float(d);
+    key->value[2] = read_float(d);
+    key->value[3] = read_float(d);
+}
+
+void
+write_skm_anim(struct serializer *s, struct skm_armature_anim *anim) {
+    write_u32(s, SKM_ANIM_RECORD_VERSION);
+
+    write_float(s, anim->length);
+    write_u32(s, (uint32_t)anim->skm->bone_count);
+
+    for(size_t i = 0; i < anim->skm->bone_count; ++i) {
+        struct skm_arm_anim_bone *bone = &anim->bones[i];
+        write_array(s, bone->position_count, bone->position, sizeof(*bone->position), write_vec3_key);
+        write_array(s, bone->scale_count, bone->scale, sizeof(*bone->scale), write_vec3_key);
+        write_array(s, bone->rotation_count, bone->rotation, sizeof(*bone->rotation), write_quat_key);
+    }
+}
+
+bool
+read_skm_anim(struct deserializer *d, struct skm_armature_anim *anim, struct skeletal_mesh *skm) {
+    uint32_t version = read_u32(d);
+    if(d->failed || version != SKM_ANIM_RECORD_VERSION) {
+        SDL_Log("read_skm_anim: unsupported animation record version %u", version);
+        return false;
+    }
+
+    anim->length = read_float(d);
+    size_t bone_count = read_u32(d);
+
+    if(d->failed || bone_count != skm->bone_count) return false;
+
+    anim->skm = skm;
+    anim->bones = eng_zalloc(sizeof(*anim->bones) * bone_count);
+
+    for(size_t i = 0; i < bone_count; ++i) {
+        struct skm_arm_anim_bone *bone = &anim->bones[i];
+        bone->position = read_array(d, &bone->position_count, sizeof(*bone->position), read_vec3_key);
+        bone->scale = read_array(d, &bone->scale_count, sizeof(*bone->scale), read_vec3_key);
+        bone->rotation = read_array(d, &bone->rotation_count, sizeof(*bone->rotation), read_quat_key);
+    }
+
+    if(d->failed) {
+        for(size_t i = 0; i < bone_count; ++i) {
+            struct skm_arm_anim_bone *bone = &anim->bones[i];
+            eng_free(bone->position, sizeof(*bone->position) * bone->position_count);
+            eng_free(bone->scale, sizeof(*bone->scale) * bone->scale_count);
+            eng_free(bone->rotation, sizeof(*bone->rotation) * bone->rotation_count);
+        }
+        eng_free(anim->bones, sizeof(*anim->bones) * bone_count);
+        anim->bones = NULL;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,38 @@
+#include "engine/serialize/serialize_stm.h"
+
+#include "engine/alloc.h"
+
+void
+write_stm(struct serializer *s, struct static_mesh *stm) {
+    write_u32(s, STM_RECORD_VERSION);
+
+    write_float_array(s, stm->vertices_count, stm->vertices);
+    write_u32_array(s, stm->triangles_count, stm->triangles);
+}
+
+bool
+read_stm(struct deserializer *d, struct static_mesh *stm) {
+    uint32_t version = read_u32(d);
+    if(d->failed || version != STM_RECORD_VERSION) {
+        SDL_Log("read_stm: unsupported static mesh record version %u", version);
+        return false;
+    }
+
+    stm->vertices = read_float_array(d, &stm->vertices_count);
+    stm->triangles = read_u32_array(d, &stm->triangles_count);
+
+    if(d->failed || stm->vertices_count % STATIC_MESH_4BYTES_COUNT != 0) {
+        eng_free(stm->vertices, sizeof(*stm->vertices) * stm->vertices_count);
+        eng_free(stm->triangles, sizeof(*stm->triangles) * stm->triangles_count);
+        stm->vertices = NULL;
+        stm->triangles = NULL;
+        stm->vertices_count = 0;
+        stm->triangles_count = 0;
+        return false;
+    }
+
+    stm->array_buf = 0;
+    stm->import_key = NULL;
+
+    return true;
+}
@@ -1,11 +1,19 @@
 #include "skeletal_mesh.h"
 
+// Before alloc.h, which poisons malloc for the intrinsics headers.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SKM_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
 #include "types.h"
 #include "alloc.h"
 #include "model.h"
 
 #include "our_gl.h"
 
+#include <math.h>
+
 void
 skm_init(struct skeletal_mesh *skm, float *vertices, size_t vertices_count, GLuint *triangles, size_t triangles_count, GLuint shader) {
     const size_t bytes = vertices_count * sizeof(*vertices);
@@ -32,63 +40,164 @@ skm_gl_init(struct skeletal_mesh *skm) {
     REPORT(glGenBuffers(1, &skm->array_buf));
     REPORT(glGenBuffers(1, &skm->element_buf));
 
-    REPORT(glGenTextures(1, &skm->bone_tform_tex));
+    skm->skeleton_row_uniform = -1;
+    skm->pos_scale_uniform = -1;
+    if(skm->shader) {
+        REPORT(skm->skeleton_row_uniform = glGetUniformLocation(skm->shader, "u_skeleton_row"));
+        REPORT(skm->pos_scale_uniform = glGetUniformLocation(skm->shader, "u_pos_scale"));
+    }
 
-    REPORT(glBindTexture(GL_TEXTURE_2D, skm->bone_tform_tex));
-    REPORT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
-    REPORT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    skm_gl_upload(skm);
+}
 
-    REPORT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-    REPORT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+float
+skm_pack_vertices(const float *vertices, size_t vertex_count, struct skm_packed_vertex *out) {
+    // One scale for all three axes keeps the shader to a single multiply.
+    float scale = 0.0f;
+    for(size_t i = 0; i < vertex_count; ++i) {
+        const float *v = vertices + i * SKEL_MESH_4BYTES_COUNT;
+        for(size_t k = 0; k < 3; ++k) scale = fmaxf(scale, fabsf(v[k]));
+    }
+    if(scale == 0.0f) scale = 1.0f;
 
-    skm_gl_upload(skm);
+    bool warned = false;
+    bool warned_uv = false;
+    for(size_t i = 0; i < vertex_count; ++i) {
+        const float *v = vertices + i * SKEL_MESH_4BYTES_COUNT;
+        struct skm_packed_vertex *p = &out[i];
+
+        for(size_t k = 0; k < 3; ++k) {
+            p->position[k] = (int16_t)lroundf(ourgl_clampf(v[k] / scale, -1.0f, 1.0f) * 32767.0f);
+            p->normal[k] = (int8_t)lroundf(ourgl_clampf(v[3 + k], -1.0f, 1.0f) * 127.0f);
+        }
+        p->position[3] = 0;
+        p->normal[3] = 0;
+
+        // Unused slots have index -1 (and weight 0); any valid bone will do
+        // for them.
+        int total = 0;
+        size_t largest = 0;
+        for(size_t k = 0; k < 4; ++k) {
+            float idx = v[10 + k];
+            if(idx > 255.0f && !warned) {
+                SDL_Log("skm_pack_vertices: bone index %g doesn't fit in a byte", idx);
+                warned = true;
+            }
+            p->bone[k] = (uint8_t)ourgl_clampf(idx, 0.0f, 255.0f);
+            p->weight[k] = (uint8_t)lroundf(ourgl_clampf(v[6 + k], 0.0f, 1.0f) * 255.0f);
+
+            total += p->weight[k];
+            if(v[6 + k] > v[6 + largest]) largest = k;
+        }
+
+        // Rounding can leave the weights a step or two off 255, which would
+        // scale the vertex slightly. The biggest weight absorbs the error.
+        if(total > 0) {
+            int fixed = (int)p->weight[largest] + (255 - total);
+            p->weight[largest] = (uint8_t)(fixed < 0 ? 0 : (fixed > 255 ? 255 : fixed));
+        }
+
+        if(!ourgl_pack_uv(&v[14], p->uv) && !warned_uv) {
+            SDL_Log("skm_pack_vertices: uv (%g, %g) is outside [0, 1], and gets clamped", v[14], v[15]);
+            warned_uv = true;
+        }
+    }
+
+    return scale;
 }
 
 /**
- * Re-uploads the vertex data for the given mesh.
+ * Packs and re-uploads the vertex data for the given mesh.
  */
 void
 skm_gl_upload(struct skeletal_mesh *skm) {
-    size_t bytes = sizeof(*skm->vertices) * skm->vertices_count;
+    size_t vertex_count = skm->vertices_count / SKEL_MESH_4BYTES_COUNT;
+    size_t bytes = sizeof(struct skm_packed_vertex) * vertex_count;
+
+    // The float vertices stay on the mesh, since calling this again re-packs
+    // from them (and write_skm bakes them); the GPU only gets the packed ones.
+    struct skm_packed_vertex *packed = eng_zalloc(bytes);
+    skm->position_scale = skm_pack_vertices(skm->vertices, vertex_count, packed);
 
     REPORT(glBindBuffer(GL_ARRAY_BUFFER, skm->array_buf));
-    REPORT(glBufferData(GL_ARRAY_BUFFER, bytes, skm->vertices, GL_STATIC_DRAW));
+    REPORT(glBufferData(GL_ARRAY_BUFFER, bytes, packed, GL_STATIC_DRAW));
+
+    eng_free(packed, bytes);
 
-    size_t tbytes = sizeof(*skm->triangles) * skm->triangles_count;
+    skm->index_type = ourgl_index_type(vertex_count);
+    size_t tbytes = ourgl_index_size(skm->index_type) * skm->triangles_count;
+
+    void *indices = skm->triangles;
+    if(skm->index_type == GL_UNSIGNED_SHORT) {
+        indices = eng_zalloc(tbytes);
+        ourgl_narrow_indices(skm->triangles, skm->triangles_count, indices);
+    }
 
     REPORT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skm->element_buf));
-    REPORT(glBufferData(GL_ELEMENT_ARRAY_BUFFER, tbytes, skm->triangles, GL_STATIC_DRAW));
+    REPORT(glBufferData(GL_ELEMENT_ARRAY_BUFFER, tbytes, indices, GL_STATIC_DRAW));
+
+    if(indices != skm->triangles) eng_free(indices, tbytes);
 }
 
 /**
- * Draws the skeletal mesh using opengl.
+ * Draws count instances of the skeletal mesh using opengl.
  */
 void
-skm_gl_draw(struct skeletal_mesh *skm) {
+skm_gl_draw_instances(struct skeletal_mesh *skm, struct skm_instance *instances, size_t count) {
+    if(count == 0) return;
+
+    // Without an atlas there is no pose to draw with. That's a bug in the
+    // caller (skm_palette_atlas_add was never called), not something to draw
+    // around.
+    if(!instances[0].atlas) {
+        SDL_Log("skm_gl_draw_instances: the instances aren't in a palette atlas");
+        return;
+    }
+
+    skm_gl_bind_vertices(skm);
+
+    REPORT(glUseProgram(skm->shader));
+    REPORT(glUniform1f(skm->pos_scale_uniform, skm->position_scale));
+
+    REPORT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skm->element_buf));
+
+    REPORT(glActiveTexture(GL_TEXTURE1));
+    REPORT(glBindTexture(GL_TEXTURE_2D, instances[0].atlas->tex));
+
+    // Each instance's pose (including where it is in the world) is entirely
+    // in its rows of the atlas, so that is all that changes between draws.
+    for(size_t i = 0; i < count; ++i) {
+        REPORT(glUniform1f(skm->skeleton_row_uniform, (float)instances[i].palette_row));
+        REPORT(glDrawElements(GL_TRIANGLES, skm->triangles_count, skm->index_type, 0));
+    }
+}
+
+void
+skm_gl_bind_vertices(struct skeletal_mesh *skm) {
+    const GLsizei stride = sizeof(struct skm_packed_vertex);
+
     REPORT(glBindBuffer(GL_ARRAY_BUFFER, skm->array_buf));
 
-    REPORT(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, SKEL_MESH_4BYTES_COUNT * sizeof(float), (void*)0));
+    REPORT(glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, stride, (void*)offsetof(struct skm_packed_vertex, position)));
     REPORT(glEnableVertexAttribArray(0));
 
-    REPORT(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, SKEL_MESH_4BYTES_COUNT * sizeof(float), (void*)(sizeof(float) * 3)));
+    REPORT(glVertexAttribPointer(1, 3, GL_BYTE, GL_TRUE, stride, (void*)offsetof(struct skm_packed_vertex, normal)));
     REPORT(glEnableVertexAttribArray(1));
 
-    REPORT(glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, SKEL_MESH_4BYTES_COUNT * sizeof(float), (void*)(sizeof(float) * 6)));
+    REPORT(glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(struct skm_packed_vertex, weight)));
     REPORT(glEnableVertexAttribArray(2));
 
-    REPORT(glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, SKEL_MESH_4BYTES_COUNT * sizeof(float), (void*)(sizeof(float) * 10)));
+    // Not normalized: the shader gets the bone indices as floats 0..255.
+    REPORT(glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_FALSE, stride, (void*)offsetof(struct skm_packed_vertex, bone)));
     REPORT(glEnableVertexAttribArray(3));
 
-    REPORT(glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, SKEL_MESH_4BYTES_COUNT * sizeof(float), (void*)(sizeof(float) * 14)));
+    REPORT(glVertexAttribPointer(4, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(struct skm_packed_vertex, uv)));
     REPORT(glEnableVertexAttribArray(4));
+}
 
-    REPORT(glUseProgram(skm->shader));
-
-    REPORT(glActiveTexture(GL_TEXTURE1));
-    REPORT(glBindTexture(GL_TEXTURE_2D, skm->bone_tform_tex));
-
-    REPORT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skm->element_buf));
-    REPORT(glDrawElements(GL_TRIANGLES, skm->triangles_count, GL_UNSIGNED_INT, 0));
+void
+skm_gl_draw(struct skm_instance *inst) {
+    skm_gl_draw_instances(inst->skm, inst, 1);
 }
 
 void
@@ -100,45 +209,50 @@ skm_destroy(struct skeletal_mesh *skm) {
     // TODO destroy GL properties
 }
 
-static void
-skm_compute_dfs(struct skeletal_mesh *skm, int idx, mat4 root_pose) {
-    if(idx == -1) return;
-
-    if(skm->bone_compute_graph[idx]) return;
-
-    skm->bone_compute_graph[idx] = true;
+void
+skm_instance_init(struct skm_instance *inst, struct skeletal_mesh *skm) {
+    inst->skm = skm;
 
-    mat4 parent_matrix;
-    int parent_idx = skm->bone_heirarchy[idx];
-    
-    if(parent_idx < 0) {
-        glm_mat4_copy(root_pose, parent_matrix);
-    }
-    else {
-        skm_compute_dfs(skm, parent_idx, root_pose);
-        
-        glm_mat4_copy(skm->bone_pose[parent_idx], parent_matrix);
-    }
+    inst->bone_local_pose = eng_zalloc(sizeof(mat4) * skm->bone_count);
+    memcpy(inst->bone_local_pose, skm->bone_local_pose, sizeof(mat4) * skm->bone_count);
 
-    glm_mat4_mul(parent_matrix, skm->bone_local_pose[idx], skm->bone_pose[idx]);
+    inst->bone_pose = eng_zalloc(sizeof(mat4) * skm->bone_count);
+    inst->bone_tform_tex_data = eng_zalloc(sizeof(float) * 4 * skm_palette_texels(skm) * skm->bone_count);
+    inst->atlas = NULL;
+    inst->palette_row = 0;
 }
 
+void
+skm_instance_free(struct skm_instance *inst) {
+    size_t bone_count = inst->skm->bone_count;
+    eng_free(inst->bone_local_pose, sizeof(mat4) * bone_count);
+    eng_free(inst->bone_pose, sizeof(mat4) * bone_count);
+    // Rows in an atlas belong to the atlas.
+    if(!inst->atlas) eng_free(inst->bone_tform_tex_data, sizeof(float) * 4 * skm_palette_texels(inst->skm) * bone_count);
+    inst->bone_local_pose = NULL;
+    inst->bone_pose = NULL;
+    inst->bone_tform_tex_data = NULL;
+    inst->atlas = NULL;
+}
 
+struct skm_anim_stats skm_anim_stats = {0};
 
 void
-skm_compute_matrices(struct skeletal_mesh *skm, mat4 root_pose) {
-    // Reset the graph
-    for(size_t i = 0; i < skm->bone_count; ++i) {
-        skm->bone_compute_graph[i] = false;
-    }
+skm_compute_matrices(struct skm_instance *inst, mat4 root_pose) {
+    const struct skeletal_mesh *skm = inst->skm;
 
+    // Parents always come before their children, so by the time we get to a
+    // bone its parent's pose is already final.
     for(size_t i = 0; i < skm->bone_count; ++i) {
-        skm_compute_dfs(skm, i, root_pose);
+        int parent_idx = skm->bone_heirarchy[i];
+        mat4 *parent_matrix = parent_idx < 0 ? (mat4*)root_pose : &inst->bone_pose[parent_idx];
+
+        glm_mat4_mul(*parent_matrix, inst->bone_local_pose[i], inst->bone_pose[i]);
     }
 }
 
-void
-skm_arm_bone_lerp_keys(struct skm_arm_anim_bone_playback *state, struct skm_arm_anim_bone *keys, float time) {
+static void
+skm_arm_bone_lerp_keys(struct skm_arm_anim_bone_playback *state, struct skm_arm_anim_bone *keys, float time, struct skm_pose *pose, size_t bone) {
     struct skm_vec3_key *p0 = &keys->position[state->position_idx];
     struct skm_vec3_key *p1 = p0;
     if(state->position_idx + 1 < keys->position_count) {
@@ -148,10 +262,8 @@ skm_arm_bone_lerp_keys(struct skm_arm_anim_bone_playback *state, struct skm_arm_
     float t = 0.0;
 
     if(p0 != p1) { t = (time - p0->time) / (p1->time - p0->time); }
-    
 
-    vec3 pos;
-    glm_vec3_lerp(p0->value, p1->value, t, pos);
+    glm_vec3_lerp(p0->value, p1->value, t, pose->position[bone]);
 
     p0 = &keys->scale[state->scale_idx];
     p1 = p0;
@@ -162,8 +274,7 @@ skm_arm_bone_lerp_keys(struct skm_arm_anim_bone_playback *state, struct skm_arm_
     t = 0.0;
     if(p0 != p1) { t = (time - p0->time) / (p1->time - p0->time); }
 
-    vec3 scale;
-    glm_vec3_lerp(p0->value, p1->value, t, scale);
+    glm_vec3_lerp(p0->value, p1->value, t, pose->scale[bone]);
 
     struct skm_quat_key *q0 = &keys->rotation[state->rotation_idx];
     struct skm_quat_key *q1 = q0;
@@ -173,137 +284,875 @@ skm_arm_bone_lerp_keys(struct skm_arm_anim_bone_playback *state, struct skm_arm_
 
     t = 0.0;
     if(q0 != q1) { t = (time - q0->time) / (q1->time - q0->time); }
-    
 
-    versor rot;
-    glm_quat_slerp(q0->value, q1->value, t, rot);
+    glm_quat_slerp(q0->value, q1->value, t, pose->rotation[bone]);
+}
+
+/* How many keys a cursor is allowed to walk forwards one at a time before we
+ * switch to galloping ahead and binary searching. Normal playback only ever
+ * moves a key or two per tick, so this keeps stepping O(1) per channel while
+ * large jumps (seeks, loop wrap-around, huge dt) stay logarithmic. */
+#define SKM_CURSOR_LINEAR_STEPS 4
+
+/* Returns the index of the last key whose time is <= the given time (or 0 if
+ * the time is before the first key), using idx as a starting hint. */
+#define IMPL_KEY_CURSOR(sname, keytype) \
+static size_t \
+skm_ ## sname ## _cursor(keytype *keys, size_t count, size_t idx, float time) { \
+    if(idx >= count || keys[idx].time > time) { \
+        /* We went backwards, search the whole channel. */ \
+        if(keys[0].time > time) return 0; \
+        idx = 0; \
+    } \
+    for(int i = 0; i < SKM_CURSOR_LINEAR_STEPS; ++i) { \
+        if(idx + 1 >= count || keys[idx + 1].time > time) return idx; \
+        idx += 1; \
+    } \
+    /* Gallop forwards so the search stays near the cursor. */ \
+    size_t lo = idx; \
+    size_t hi = count; \
+    for(size_t jump = 1; lo + jump < count; jump *= 2) { \
+        if(keys[lo + jump].time > time) { hi = lo + jump; break; } \
+        lo += jump; \
+    } \
+    while(hi - lo > 1) { \
+        size_t mid = lo + (hi - lo) / 2; \
+        if(keys[mid].time <= time) lo = mid; \
+        else hi = mid; \
+    } \
+    return lo; \
+}
 
-    glm_vec3_copy(pos, state->position);
-    glm_vec3_copy(scale, state->scale);
-    glm_quat_copy(rot, state->rotation);
+IMPL_KEY_CURSOR(vec3, struct skm_vec3_key)
+IMPL_KEY_CURSOR(quat, struct skm_quat_key)
 
-    //glm_translate_make(state->position_matrix, pos);
-    //glm_quat_mat4(rot, state->rotation_matrix);
-    //glm_scale_make(state->scale_matrix, scale);
+/**
+ * Moves the key cursors for a single bone to the given time, starting from
+ * wherever they currently are, and samples the bone into pose.
+ */
+static void
+skm_arm_bone_advance(struct skm_arm_anim_bone_playback *state, struct skm_arm_anim_bone *keys, float time, struct skm_pose *pose, size_t bone) {
+    state->position_idx = skm_vec3_cursor(keys->position, keys->position_count, state->position_idx, time);
+    state->rotation_idx = skm_quat_cursor(keys->rotation, keys->rotation_count, state->rotation_idx, time);
+    state->scale_idx = skm_vec3_cursor(keys->scale, keys->scale_count, state->scale_idx, time);
+
+    skm_arm_bone_lerp_keys(state, keys, time, pose, bone);
 }
 
-void
-skm_arm_bone_seek(struct skm_arm_anim_bone_playback *state, struct skm_arm_anim_bone *keys, float time) {
+static void
+skm_arm_bone_seek(struct skm_arm_anim_bone_playback *state, struct skm_arm_anim_bone *keys, float time, struct skm_pose *pose, size_t bone) {
     state->position_idx = 0;
     state->rotation_idx = 0;
     state->scale_idx = 0;
 
-    while(state->position_idx + 1 < keys->position_count) {
-        if(keys->position[state->position_idx + 1].time > time) {
-            break;
-        }
+    skm_arm_bone_advance(state, keys, time, pose, bone);
+}
 
-        state->position_idx += 1;
+// skm_arm_playback_seek without counting towards skm_anim_stats, for samples
+// that aren't part of a tick (setting up a playback, baking a clip).
+static void
+skm_arm_playback_seek_uncounted(struct skm_armature_anim_playback *playback, float time) {
+    for(size_t i = 0; i < playback->anim->skm->bone_count; ++i) {
+        skm_arm_bone_seek(&playback->state[i], &playback->anim->bones[i], time, &playback->pose, i);
     }
+    playback->time = time;
+    playback->stale = false;
+}
+
+void
+skm_arm_playback_seek(struct skm_armature_anim_playback *playback, float time) {
+    if(!playback->anim->skm) return;
+    skm_arm_playback_seek_uncounted(playback, time);
+
+    skm_anim_stats.playbacks_sampled += 1;
+    skm_anim_stats.bones_sampled += playback->anim->skm->bone_count;
+}
+
+void
+skm_arm_playback_init(struct skm_armature_anim_playback *playback, struct skm_armature_anim *anim) {
+    playback->anim = anim;
+    if(!anim->skm) return;
+    playback->state = eng_zalloc(sizeof(*playback->state) * anim->skm->bone_count);
+    skm_pose_init(&playback->pose, anim->skm->bone_count);
+    skm_arm_playback_seek_uncounted(playback, 0.0f);
+}
+
+void
+skm_arm_playback_free(struct skm_armature_anim_playback *playback) {
+    eng_free(playback->state, sizeof(*playback->state) * playback->pose.bone_count);
+    skm_pose_free(&playback->pose);
+    playback->state = NULL;
+}
+
+void
+skm_arm_playback_apply(struct skm_armature_anim_playback *playback, struct skm_instance *inst) {
+    skm_pose_compose(&playback->pose, inst->bone_local_pose);
+}
+
+void
+skm_arm_playback_set_loop(struct skm_armature_anim_playback *playback, float start, float end) {
+    playback->loop_start = start;
+    playback->loop_end = end;
+}
+
+void
+skm_arm_playback_advance(struct skm_armature_anim_playback *playback, float step) {
+    float time = playback->time + step;
+
+    float loop_length = playback->loop_end - playback->loop_start;
+    if(loop_length > 0.0f && time >= playback->loop_end) {
+        time = playback->loop_start + fmodf(time - playback->loop_start, loop_length);
+    }
+
+    playback->time = time;
+    playback->stale = true;
+}
+
+void
+skm_arm_playback_sample(struct skm_armature_anim_playback *playback) {
+    if(!playback->stale || !playback->anim->skm) return;
+
+    // The cursors pick up from where the last sample left them, however long
+    // ago that was. Wrapping around the loop (or having been dormant for a
+    // while) just looks like a backwards jump to them.
+    for(size_t i = 0; i < playback->anim->skm->bone_count; ++i) {
+        skm_arm_bone_advance(&playback->state[i], &playback->anim->bones[i], playback->time, &playback->pose, i);
+    }
+    playback->stale = false;
+
+    skm_anim_stats.playbacks_sampled += 1;
+    skm_anim_stats.bones_sampled += playback->anim->skm->bone_count;
+}
+
+void
+skm_arm_playback_step(struct skm_armature_anim_playback *playback, float step) {
+    skm_arm_playback_advance(playback, step);
+    skm_arm_playback_sample(playback);
+}
+
+void
+skm_anim_stats_reset(void) {
+    skm_anim_stats.playbacks_sampled = 0;
+    skm_anim_stats.bones_sampled = 0;
+}
+
+void
+skm_pose_init(struct skm_pose *pose, size_t bone_count) {
+    pose->bone_count = bone_count;
+    pose->position = eng_zalloc(sizeof(*pose->position) * bone_count);
+    pose->rotation = eng_zalloc(sizeof(*pose->rotation) * bone_count);
+    pose->scale = eng_zalloc(sizeof(*pose->scale) * bone_count);
+
+    for(size_t i = 0; i < bone_count; ++i) {
+        glm_quat_identity(pose->rotation[i]);
+        glm_vec3_one(pose->scale[i]);
+    }
+}
+
+void
+skm_pose_free(struct skm_pose *pose) {
+    eng_free(pose->position, sizeof(*pose->position) * pose->bone_count);
+    eng_free(pose->rotation, sizeof(*pose->rotation) * pose->bone_count);
+    eng_free(pose->scale, sizeof(*pose->scale) * pose->bone_count);
+    pose->bone_count = 0;
+}
+
+void
+skm_pose_copy(struct skm_pose *dest, struct skm_pose *src) {
+    memcpy(dest->position, src->position, sizeof(*src->position) * src->bone_count);
+    memcpy(dest->rotation, src->rotation, sizeof(*src->rotation) * src->bone_count);
+    memcpy(dest->scale, src->scale, sizeof(*src->scale) * src->bone_count);
+}
+
+static inline float
+skm_layer_weight(const struct skm_pose_layer *layer, size_t bone) {
+    return layer->mask ? layer->weight * layer->mask[bone] : layer->weight;
+}
+
+void
+skm_pose_blend(struct skm_pose *out, const struct skm_pose_layer *layers, size_t count) {
+    if(count == 0) return;
+
+    for(size_t i = 0; i < out->bone_count; ++i) {
+        vec3 position = GLM_VEC3_ZERO_INIT;
+        vec3 scale = GLM_VEC3_ZERO_INIT;
+        versor rotation = GLM_VEC4_ZERO_INIT;
+        float total = 0.0f;
+
+        // Quaternions are only summed in the hemisphere of the first one, or
+        // opposite rotations would cancel out.
+        versor *hemisphere = &layers[0].pose->rotation[i];
+
+        for(size_t l = 0; l < count; ++l) {
+            struct skm_pose *pose = layers[l].pose;
+            float w = skm_layer_weight(&layers[l], i);
+            if(w <= 0.0f) continue;
+
+            glm_vec3_muladds(pose->position[i], w, position);
+            glm_vec3_muladds(pose->scale[i], w, scale);
 
-    while(state->rotation_idx + 1 < keys->rotation_count) {
-        if(keys->rotation[state->rotation_idx + 1].time > time) {
-            break;
+            float qw = glm_quat_dot(pose->rotation[i], *hemisphere) < 0.0f ? -w : w;
+            glm_vec4_muladds(pose->rotation[i], qw, rotation);
+
+            total += w;
+        }
+
+        if(total <= 0.0f) {
+            struct skm_pose *first = layers[0].pose;
+            if(first != out) {
+                glm_vec3_copy(first->position[i], out->position[i]);
+                glm_quat_copy(first->rotation[i], out->rotation[i]);
+                glm_vec3_copy(first->scale[i], out->scale[i]);
+            }
+            continue;
         }
 
-        state->rotation_idx += 1;
+        glm_vec3_scale(position, 1.0f / total, out->position[i]);
+        glm_vec3_scale(scale, 1.0f / total, out->scale[i]);
+        glm_quat_normalize_to(rotation, out->rotation[i]);
     }
+}
 
-    while(state->scale_idx + 1 < keys->scale_count) {
-        if(keys->scale[state->scale_idx + 1].time > time) {
-            break;
+void
+skm_pose_make_additive(struct skm_pose *out, struct skm_pose *pose, struct skm_pose *reference) {
+    for(size_t i = 0; i < out->bone_count; ++i) {
+        glm_vec3_sub(pose->position[i], reference->position[i], out->position[i]);
+
+        versor inverse;
+        glm_quat_conjugate(reference->rotation[i], inverse);
+        glm_quat_mul(pose->rotation[i], inverse, out->rotation[i]);
+
+        for(size_t c = 0; c < 3; ++c) {
+            float r = reference->scale[i][c];
+            out->scale[i][c] = r != 0.0f ? pose->scale[i][c] / r : 1.0f;
         }
+    }
+}
+
+void
+skm_pose_add(struct skm_pose *pose, const struct skm_pose_layer *additive) {
+    struct skm_pose *delta = additive->pose;
+    versor identity = GLM_QUAT_IDENTITY_INIT;
+    vec3 one = GLM_VEC3_ONE_INIT;
+
+    for(size_t i = 0; i < pose->bone_count; ++i) {
+        float w = skm_layer_weight(additive, i);
+        if(w == 0.0f) continue;
+
+        glm_vec3_muladds(delta->position[i], w, pose->position[i]);
+
+        versor rotation;
+        glm_quat_nlerp(identity, delta->rotation[i], w, rotation);
+        glm_quat_mul(rotation, pose->rotation[i], pose->rotation[i]);
 
-        state->scale_idx += 1;
+        vec3 scale;
+        glm_vec3_lerp(one, delta->scale[i], w, scale);
+        glm_vec3_mul(pose->scale[i], scale, pose->scale[i]);
     }
+}
+
+void
+skm_pose_compose(struct skm_pose *pose, mat4 *local_matrices) {
+    for(size_t i = 0; i < pose->bone_count; ++i) {
+        float *m = (float*)local_matrices[i];
+        float *s = pose->scale[i];
+        float x = pose->rotation[i][0], y = pose->rotation[i][1], z = pose->rotation[i][2], w = pose->rotation[i][3];
+
+        // The rotation matrix of a unit quaternion, with each column scaled.
+        float xx = 2.0f * x * x, yy = 2.0f * y * y, zz = 2.0f * z * z;
+        float xy = 2.0f * x * y, xz = 2.0f * x * z, yz = 2.0f * y * z;
+        float wx = 2.0f * w * x, wy = 2.0f * w * y, wz = 2.0f * w * z;
+
+        m[0]  = (1.0f - yy - zz) * s[0];
+        m[1]  = (xy + wz) * s[0];
+        m[2]  = (xz - wy) * s[0];
+        m[3]  = 0.0f;
+
+        m[4]  = (xy - wz) * s[1];
+        m[5]  = (1.0f - xx - zz) * s[1];
+        m[6]  = (yz + wx) * s[1];
+        m[7]  = 0.0f;
+
+        m[8]  = (xz + wy) * s[2];
+        m[9]  = (yz - wx) * s[2];
+        m[10] = (1.0f - xx - yy) * s[2];
+        m[11] = 0.0f;
+
+        m[12] = pose->position[i][0];
+        m[13] = pose->position[i][1];
+        m[14] = pose->position[i][2];
+        m[15] = 1.0f;
+    }
+}
 
-    skm_arm_bone_lerp_keys(state, keys, time);
+// Copies one channel out of the per-bone arrays. The vec3 and quat keys differ
+// only in their value type, so this works on both.
+#define IMPL_SOA_CHANNEL_INIT(sname, member, ncomp) \
+static void \
+skm_soa_ ## sname ## _init(struct skm_soa_channel *ch, struct skm_armature_anim *anim, size_t bone_count) { \
+    ch->components = ncomp; \
+    ch->first = eng_zalloc(sizeof(*ch->first) * bone_count); \
+    ch->count = eng_zalloc(sizeof(*ch->count) * bone_count); \
+    ch->key_count = 0; \
+    for(size_t i = 0; i < bone_count; ++i) { \
+        ch->first[i] = (uint32_t)ch->key_count; \
+        ch->count[i] = (uint32_t)anim->bones[i].member ## _count; \
+        ch->key_count += anim->bones[i].member ## _count; \
+    } \
+    ch->times = eng_zalloc(sizeof(*ch->times) * ch->key_count); \
+    ch->values = eng_zalloc(sizeof(*ch->values) * ch->key_count * ncomp); \
+    for(size_t i = 0; i < bone_count; ++i) { \
+        for(size_t k = 0; k < ch->count[i]; ++k) { \
+            size_t dst = ch->first[i] + k; \
+            ch->times[dst] = anim->bones[i].member[k].time; \
+            memcpy(&ch->values[dst * ncomp], anim->bones[i].member[k].value, sizeof(float) * ncomp); \
+        } \
+    } \
+}
+
+IMPL_SOA_CHANNEL_INIT(position, position, 3)
+IMPL_SOA_CHANNEL_INIT(rotation, rotation, 4)
+IMPL_SOA_CHANNEL_INIT(scale, scale, 3)
+
+static void
+skm_soa_channel_free(struct skm_soa_channel *ch, size_t bone_count) {
+    eng_free(ch->first, sizeof(*ch->first) * bone_count);
+    eng_free(ch->count, sizeof(*ch->count) * bone_count);
+    eng_free(ch->times, sizeof(*ch->times) * ch->key_count);
+    eng_free(ch->values, sizeof(*ch->values) * ch->key_count * ch->components);
 }
 
 void
-skm_arm_playback_seek(struct skm_armature_anim_playback *playback, float time) {
-    if(!playback->anim->skm) return;
-    for(size_t i = 0; i < playback->anim->skm->bone_count; ++i) {
-        skm_arm_bone_seek(&playback->state[i], &playback->anim->bones[i], time);
+skm_soa_clip_init(struct skm_soa_clip *clip, struct skm_armature_anim *anim) {
+    size_t bone_count = anim->skm->bone_count;
+
+    clip->bone_count = bone_count;
+    clip->length = anim->length;
+
+    skm_soa_position_init(&clip->position, anim, bone_count);
+    skm_soa_rotation_init(&clip->rotation, anim, bone_count);
+    skm_soa_scale_init(&clip->scale, anim, bone_count);
+}
+
+void
+skm_soa_clip_free(struct skm_soa_clip *clip) {
+    skm_soa_channel_free(&clip->position, clip->bone_count);
+    skm_soa_channel_free(&clip->rotation, clip->bone_count);
+    skm_soa_channel_free(&clip->scale, clip->bone_count);
+    clip->bone_count = 0;
+}
+
+// Same search as IMPL_KEY_CURSOR, over a bare array of key times.
+static size_t
+skm_time_cursor(const float *times, size_t count, size_t idx, float time) {
+    if(idx >= count || times[idx] > time) {
+        if(times[0] > time) return 0;
+        idx = 0;
+    }
+    for(int i = 0; i < SKM_CURSOR_LINEAR_STEPS; ++i) {
+        if(idx + 1 >= count || times[idx + 1] > time) return idx;
+        idx += 1;
+    }
+    size_t lo = idx;
+    size_t hi = count;
+    for(size_t jump = 1; lo + jump < count; jump *= 2) {
+        if(times[lo + jump] > time) { hi = lo + jump; break; }
+        lo += jump;
+    }
+    while(hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(times[mid] <= time) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* How many bones skm_soa_clip_sample interpolates at once. */
+#define SKM_SAMPLE_LANES 4
+
+// The lane kernels take their inputs component-major: a[c * SKM_SAMPLE_LANES +
+// lane] is component c of the first key for lane, and likewise for b and out.
+
+static void
+skm_lerp_lanes(float *out, const float *a, const float *b, const float *t, size_t components) {
+#ifdef SKM_USE_SSE
+    __m128 tv = _mm_loadu_ps(t);
+    for(size_t c = 0; c < components; ++c) {
+        __m128 av = _mm_loadu_ps(a + c * 4);
+        __m128 bv = _mm_loadu_ps(b + c * 4);
+        _mm_storeu_ps(out + c * 4, _mm_add_ps(av, _mm_mul_ps(_mm_sub_ps(bv, av), tv)));
+    }
+#else
+    for(size_t c = 0; c < components; ++c) {
+        for(size_t l = 0; l < SKM_SAMPLE_LANES; ++l) {
+            size_t i = c * SKM_SAMPLE_LANES + l;
+            out[i] = a[i] + (b[i] - a[i]) * t[l];
+        }
+    }
+#endif
+}
+
+// Lerps along the shorter arc and renormalizes.
+static void
+skm_nlerp_lanes(float *out, const float *a, const float *b, const float *t) {
+#ifdef SKM_USE_SSE
+    __m128 tv = _mm_loadu_ps(t);
+    __m128 av[4], bv[4];
+    __m128 dot = _mm_setzero_ps();
+    for(size_t c = 0; c < 4; ++c) {
+        av[c] = _mm_loadu_ps(a + c * 4);
+        bv[c] = _mm_loadu_ps(b + c * 4);
+        dot = _mm_add_ps(dot, _mm_mul_ps(av[c], bv[c]));
+    }
+
+    // Flip b where the dot product is negative.
+    __m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+
+    __m128 r[4];
+    __m128 len2 = _mm_setzero_ps();
+    for(size_t c = 0; c < 4; ++c) {
+        __m128 bc = _mm_xor_ps(bv[c], flip);
+        r[c] = _mm_add_ps(av[c], _mm_mul_ps(_mm_sub_ps(bc, av[c]), tv));
+        len2 = _mm_add_ps(len2, _mm_mul_ps(r[c], r[c]));
+    }
+
+    __m128 inv_len = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len2));
+    for(size_t c = 0; c < 4; ++c) {
+        _mm_storeu_ps(out + c * 4, _mm_mul_ps(r[c], inv_len));
+    }
+#else
+    for(size_t l = 0; l < SKM_SAMPLE_LANES; ++l) {
+        float dot = 0.0f;
+        for(size_t c = 0; c < 4; ++c) dot += a[c * SKM_SAMPLE_LANES + l] * b[c * SKM_SAMPLE_LANES + l];
+        float sign = dot < 0.0f ? -1.0f : 1.0f;
+
+        float r[4];
+        float len2 = 0.0f;
+        for(size_t c = 0; c < 4; ++c) {
+            float av = a[c * SKM_SAMPLE_LANES + l];
+            float bv = b[c * SKM_SAMPLE_LANES + l] * sign;
+            r[c] = av + (bv - av) * t[l];
+            len2 += r[c] * r[c];
+        }
+
+        float inv_len = 1.0f / sqrtf(len2);
+        for(size_t c = 0; c < 4; ++c) out[c * SKM_SAMPLE_LANES + l] = r[c] * inv_len;
+    }
+#endif
+}
+
+// Samples one channel of every bone. The key search is per bone, but the
+// interpolation runs SKM_SAMPLE_LANES bones at a time. Bones without keys get
+// rest (identity) values.
+static void
+skm_soa_channel_sample(struct skm_soa_channel *ch, uint32_t *cursors, float time, float *out, size_t out_stride, size_t bone_count, const float *rest) {
+    const size_t nc = ch->components;
+
+    for(size_t base = 0; base < bone_count; base += SKM_SAMPLE_LANES) {
+        float a[4 * SKM_SAMPLE_LANES], b[4 * SKM_SAMPLE_LANES], t[SKM_SAMPLE_LANES], r[4 * SKM_SAMPLE_LANES];
+
+        for(size_t l = 0; l < SKM_SAMPLE_LANES; ++l) {
+            size_t bone = base + l;
+            const float *v0 = rest, *v1 = rest;
+            t[l] = 0.0f;
+
+            if(bone < bone_count && ch->count[bone] > 0) {
+                const float *times = &ch->times[ch->first[bone]];
+                size_t count = ch->count[bone];
+                size_t idx = skm_time_cursor(times, count, cursors[bone * 3], time);
+                size_t next = idx + 1 < count ? idx + 1 : idx;
+                cursors[bone * 3] = (uint32_t)idx;
+
+                v0 = &ch->values[(ch->first[bone] + idx) * nc];
+                v1 = &ch->values[(ch->first[bone] + next) * nc];
+                if(next != idx) t[l] = (time - times[idx]) / (times[next] - times[idx]);
+            }
+
+            for(size_t c = 0; c < nc; ++c) {
+                a[c * SKM_SAMPLE_LANES + l] = v0[c];
+                b[c * SKM_SAMPLE_LANES + l] = v1[c];
+            }
+        }
+
+        if(nc == 4) skm_nlerp_lanes(r, a, b, t);
+        else skm_lerp_lanes(r, a, b, t, nc);
+
+        for(size_t l = 0; l < SKM_SAMPLE_LANES && base + l < bone_count; ++l) {
+            for(size_t c = 0; c < nc; ++c) {
+                out[(base + l) * out_stride + c] = r[c * SKM_SAMPLE_LANES + l];
+            }
+        }
     }
-    playback->time = time;
 }
 
 void
-skm_arm_playback_init(struct skm_armature_anim_playback *playback, struct skm_armature_anim *anim) {
-    playback->anim = anim;
-    if(!anim->skm) return;
-    playback->state = eng_zalloc(sizeof(*playback->state) * anim->skm->bone_count);
-    skm_arm_playback_seek(playback, 0.0f);
+skm_soa_clip_sample(struct skm_soa_clip *clip, uint32_t *cursors, float time, struct skm_pose *pose) {
+    static const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    static const float one[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+    static const float identity[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    // versor is 16-byte aligned, so rotations are 4 floats apart and vec3s 3.
+    skm_soa_channel_sample(&clip->position, cursors + 0, time, (float*)pose->position, 3, clip->bone_count, zero);
+    skm_soa_channel_sample(&clip->rotation, cursors + 1, time, (float*)pose->rotation, 4, clip->bone_count, identity);
+    skm_soa_channel_sample(&clip->scale, cursors + 2, time, (float*)pose->scale, 3, clip->bone_count, one);
+}
+
+#define SKM_QUAT_COMPONENT_MAX 0.70710678f // 1 / sqrt(2)
+#define SKM_QUAT_COMPONENT_BITS 15
+#define SKM_QUAT_COMPONENT_STEPS ((1 << SKM_QUAT_COMPONENT_BITS) - 1)
+
+static void
+skm_quat_pack(uint16_t *out, versor q) {
+    size_t largest = 0;
+    for(size_t c = 1; c < 4; ++c) {
+        if(fabsf(q[c]) > fabsf(q[largest])) largest = c;
+    }
+
+    // q and -q are the same rotation, so make the dropped component positive.
+    float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+
+    uint64_t bits = (uint64_t)largest;
+    size_t shift = 2;
+    for(size_t c = 0; c < 4; ++c) {
+        if(c == largest) continue;
+
+        float v = q[c] * sign / SKM_QUAT_COMPONENT_MAX;
+        v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+        uint64_t quantized = (uint64_t)lroundf((v * 0.5f + 0.5f) * SKM_QUAT_COMPONENT_STEPS);
+
+        bits |= quantized << shift;
+        shift += SKM_QUAT_COMPONENT_BITS;
+    }
+
+    out[0] = (uint16_t)(bits >> 0);
+    out[1] = (uint16_t)(bits >> 16);
+    out[2] = (uint16_t)(bits >> 32);
+}
+
+static void
+skm_quat_unpack(versor q, const uint16_t *in) {
+    // Which components are stored, for each possible largest one.
+    static const uint8_t stored[4][3] = { { 1, 2, 3 }, { 0, 2, 3 }, { 0, 1, 3 }, { 0, 1, 2 } };
+    const float scale = 2.0f * SKM_QUAT_COMPONENT_MAX / SKM_QUAT_COMPONENT_STEPS;
+
+    uint64_t bits = (uint64_t)in[0] | ((uint64_t)in[1] << 16) | ((uint64_t)in[2] << 32);
+    size_t largest = (size_t)(bits & 3);
+
+    float a = (float)((bits >> 2) & SKM_QUAT_COMPONENT_STEPS) * scale - SKM_QUAT_COMPONENT_MAX;
+    float b = (float)((bits >> 17) & SKM_QUAT_COMPONENT_STEPS) * scale - SKM_QUAT_COMPONENT_MAX;
+    float c = (float)((bits >> 32) & SKM_QUAT_COMPONENT_STEPS) * scale - SKM_QUAT_COMPONENT_MAX;
+
+    q[stored[largest][0]] = a;
+    q[stored[largest][1]] = b;
+    q[stored[largest][2]] = c;
+    q[largest] = sqrtf(fmaxf(0.0f, 1.0f - a * a - b * b - c * c));
+}
+
+static void
+skm_vec3_pack(uint16_t *out, vec3 v, vec3 min, vec3 extent) {
+    for(size_t c = 0; c < 3; ++c) {
+        float n = extent[c] > 0.0f ? (v[c] - min[c]) / extent[c] : 0.0f;
+        n = n < 0.0f ? 0.0f : (n > 1.0f ? 1.0f : n);
+        out[c] = (uint16_t)lroundf(n * 65535.0f);
+    }
+}
+
+static void
+skm_vec3_unpack(vec3 v, const uint16_t *in, vec3 min, vec3 extent) {
+    for(size_t c = 0; c < 3; ++c) {
+        v[c] = min[c] + (float)in[c] * (1.0f / 65535.0f) * extent[c];
+    }
 }
 
 void
-skm_arm_playback_apply(struct skm_armature_anim_playback *playback) {
-    struct skeletal_mesh *skm = playback->anim->skm;
+skm_quantized_clip_init(struct skm_quantized_clip *clip, struct skm_armature_anim *anim, float frame_rate) {
+    size_t bone_count = anim->skm->bone_count;
+
+    clip->bone_count = bone_count;
+    clip->length = anim->length;
+    clip->frame_rate = frame_rate;
+    clip->frame_count = (size_t)ceilf(anim->length * frame_rate) + 1;
+
+    size_t entries = clip->frame_count * bone_count;
+    clip->rotation = eng_zalloc(sizeof(*clip->rotation) * 3 * entries);
+    clip->position = eng_zalloc(sizeof(*clip->position) * 3 * entries);
+    clip->scale = eng_zalloc(sizeof(*clip->scale) * 3 * entries);
+
+    clip->position_min = eng_zalloc(sizeof(*clip->position_min) * bone_count);
+    clip->position_extent = eng_zalloc(sizeof(*clip->position_extent) * bone_count);
+    clip->scale_min = eng_zalloc(sizeof(*clip->scale_min) * bone_count);
+    clip->scale_extent = eng_zalloc(sizeof(*clip->scale_extent) * bone_count);
+
+    // The ranges come from the keys themselves; linear interpolation never
+    // leaves them.
+    for(size_t i = 0; i < bone_count; ++i) {
+        struct skm_arm_anim_bone *bone = &anim->bones[i];
+
+        #define KEY_RANGE(keys, count, min, extent) \
+        { \
+            vec3 max; \
+            glm_vec3_zero(min); \
+            if(count > 0) glm_vec3_copy(keys[0].value, min); \
+            glm_vec3_copy(min, max); \
+            for(size_t k = 1; k < count; ++k) { \
+                glm_vec3_minv(min, keys[k].value, min); \
+                glm_vec3_maxv(max, keys[k].value, max); \
+            } \
+            glm_vec3_sub(max, min, extent); \
+        }
 
-    for(size_t i = 0; i < skm->bone_count; ++i) {
-        // TODO revisit
-        //glm_mat4_copy(playback->state[i].scale_matrix, skm->bone_local_pose[i]);
-        //glm_mat4_mul(playback->state[i].rotation_matrix, skm->bone_local_pose[i], skm->bone_local_pose[i]);
-        //glm_mat4_mul(playback->state[i].position_matrix, skm->bone_local_pose[i], skm->bone_local_pose[i]);
+        KEY_RANGE(bone->position, bone->position_count, clip->position_min[i], clip->position_extent[i]);
+        KEY_RANGE(bone->scale, bone->scale_count, clip->scale_min[i], clip->scale_extent[i]);
+
+        #undef KEY_RANGE
+    }
+
+    // Sample with a playback, so that the frames interpolate exactly the way
+    // the original keys did. This isn't a tick, so it stays out of
+    // skm_anim_stats.
+    struct skm_armature_anim_playback playback = {0};
+    skm_arm_playback_init(&playback, anim);
+
+    for(size_t f = 0; f < clip->frame_count; ++f) {
+        float time = fminf((float)f / frame_rate, anim->length);
+        skm_arm_playback_seek_uncounted(&playback, time);
+
+        for(size_t i = 0; i < bone_count; ++i) {
+            struct skm_pose *pose = &playback.pose;
+            size_t entry = (f * bone_count + i) * 3;
+
+            skm_quat_pack(&clip->rotation[entry], pose->rotation[i]);
+            skm_vec3_pack(&clip->position[entry], pose->position[i], clip->position_min[i], clip->position_extent[i]);
+            skm_vec3_pack(&clip->scale[entry], pose->scale[i], clip->scale_min[i], clip->scale_extent[i]);
+        }
     }
+
+    skm_arm_playback_free(&playback);
 }
 
 void
-skm_arm_playback_step(struct skm_armature_anim_playback *playback, float step) {
-    if(!playback->anim->skm) return;
-    // TODO: Make this not absurdly inefficient.
-    skm_arm_playback_seek(playback, playback->time + step);
+skm_quantized_clip_free(struct skm_quantized_clip *clip) {
+    size_t entries = clip->frame_count * clip->bone_count;
+    eng_free(clip->rotation, sizeof(*clip->rotation) * 3 * entries);
+    eng_free(clip->position, sizeof(*clip->position) * 3 * entries);
+    eng_free(clip->scale, sizeof(*clip->scale) * 3 * entries);
+
+    eng_free(clip->position_min, sizeof(*clip->position_min) * clip->bone_count);
+    eng_free(clip->position_extent, sizeof(*clip->position_extent) * clip->bone_count);
+    eng_free(clip->scale_min, sizeof(*clip->scale_min) * clip->bone_count);
+    eng_free(clip->scale_extent, sizeof(*clip->scale_extent) * clip->bone_count);
+
+    clip->bone_count = 0;
+    clip->frame_count = 0;
 }
 
-/* data layout:
- * each pixel has four values, which is one column of the matrix.
- * all coordinates in one mesh are along a row, so each row is 4 pixels.
- * the number of rows equals the number of bones. */
+void
+skm_quantized_clip_sample(struct skm_quantized_clip *clip, float time, struct skm_pose *pose) {
+    float frame = time * clip->frame_rate;
+    float last = (float)(clip->frame_count - 1);
+    frame = frame < 0.0f ? 0.0f : (frame > last ? last : frame);
+
+    size_t f0 = (size_t)frame;
+    size_t f1 = f0 + 1 < clip->frame_count ? f0 + 1 : f0;
+    float t = frame - (float)f0;
+
+    const size_t bone_count = clip->bone_count;
+    for(size_t i = 0; i < bone_count; ++i) {
+        size_t e0 = (f0 * bone_count + i) * 3;
+        size_t e1 = (f1 * bone_count + i) * 3;
+
+        versor r0, r1;
+        skm_quat_unpack(r0, &clip->rotation[e0]);
+        skm_quat_unpack(r1, &clip->rotation[e1]);
+        glm_quat_nlerp(r0, r1, t, pose->rotation[i]);
+
+        vec3 a, b;
+        skm_vec3_unpack(a, &clip->position[e0], clip->position_min[i], clip->position_extent[i]);
+        skm_vec3_unpack(b, &clip->position[e1], clip->position_min[i], clip->position_extent[i]);
+        glm_vec3_lerp(a, b, t, pose->position[i]);
+
+        skm_vec3_unpack(a, &clip->scale[e0], clip->scale_min[i], clip->scale_extent[i]);
+        skm_vec3_unpack(b, &clip->scale[e1], clip->scale_min[i], clip->scale_extent[i]);
+        glm_vec3_lerp(a, b, t, pose->scale[i]);
+    }
+}
+
+size_t
+skm_anim_key_bytes(struct skm_armature_anim *anim) {
+    size_t bytes = sizeof(*anim->bones) * anim->skm->bone_count;
+    for(size_t i = 0; i < anim->skm->bone_count; ++i) {
+        struct skm_arm_anim_bone *bone = &anim->bones[i];
+        bytes += sizeof(*bone->position) * bone->position_count;
+        bytes += sizeof(*bone->scale) * bone->scale_count;
+        bytes += sizeof(*bone->rotation) * bone->rotation_count;
+    }
+    return bytes;
+}
 
+size_t
+skm_quantized_clip_bytes(struct skm_quantized_clip *clip) {
+    return sizeof(uint16_t) * 9 * clip->frame_count * clip->bone_count
+        + sizeof(vec3) * 4 * clip->bone_count;
+}
 
+/* data layout:
+ * each pixel has four values, which is one row of the matrix. the bottom row
+ * of an affine matrix is always (0, 0, 0, 1), so it isn't stored.
+ * all coordinates in one bone are along a texture row, so each row is
+ * SKM_PALETTE_TEXELS pixels, and the number of rows equals the number of bones. */
 
-/**
- * Transforms floating point values from a range of [-something, something] to
- * [0, 1] so that we can hand them to the shader through a texture.
- */
+// Writes the unit dual quaternion for the rigid transform tform (which must
+// not scale) to dest: the rotation q, then 0.5 * (translation, 0) * q.
+static void
+skm_palette_dual_quat(float *dest, mat4 tform) {
+    versor q;
+    glm_mat4_quat(tform, q);
+
+    const float *t = tform[3];
+    dest[0] = q[0];
+    dest[1] = q[1];
+    dest[2] = q[2];
+    dest[3] = q[3];
+
+    dest[4] = 0.5f * ( t[0] * q[3] + t[1] * q[2] - t[2] * q[1]);
+    dest[5] = 0.5f * (-t[0] * q[2] + t[1] * q[3] + t[2] * q[0]);
+    dest[6] = 0.5f * ( t[0] * q[1] - t[1] * q[0] + t[2] * q[3]);
+    dest[7] = 0.5f * (-t[0] * q[0] - t[1] * q[1] - t[2] * q[2]);
+}
 
-#define upfloat(x) x
 /** 
  * Updates the bone_tform_tex_data with the given matrisx. 
  */
-
 void
-skm_set_bone_global_transform(struct skeletal_mesh *skm, int index, mat4 tform) {
-    size_t i = (index * 16);
-    // first column of matrix goes in first row, and so forth.
-    skm->bone_tform_tex_data[i + 0] = upfloat(tform[0][0]);
-    skm->bone_tform_tex_data[i + 1] = upfloat(tform[0][1]);
-    skm->bone_tform_tex_data[i + 2] = upfloat(tform[0][2]);
-    skm->bone_tform_tex_data[i + 3] = upfloat(tform[0][3]);
+skm_set_bone_global_transform(struct skm_instance *inst, int index, mat4 tform) {
+    float *data = inst->bone_tform_tex_data;
+    if(inst->skm->skinning == SKM_SKIN_DUAL_QUAT) {
+        skm_palette_dual_quat(data + index * SKM_DQ_PALETTE_TEXELS * 4, tform);
+        return;
+    }
 
-    skm->bone_tform_tex_data[i + 4] = upfloat(tform[1][0]);
-    skm->bone_tform_tex_data[i + 5] = upfloat(tform[1][1]);
-    skm->bone_tform_tex_data[i + 6] = upfloat(tform[1][2]);
-    skm->bone_tform_tex_data[i + 7] = upfloat(tform[1][3]);
+    size_t i = (index * SKM_PALETTE_FLOATS);
+    // first row of matrix goes in first pixel, and so forth. (cglm matrices
+    // are indexed [column][row].)
+    data[i + 0] = tform[0][0];
+    data[i + 1] = tform[1][0];
+    data[i + 2] = tform[2][0];
+    data[i + 3] = tform[3][0];
+
+    data[i + 4] = tform[0][1];
+    data[i + 5] = tform[1][1];
+    data[i + 6] = tform[2][1];
+    data[i + 7] = tform[3][1];
+
+    data[i + 8] = tform[0][2];
+    data[i + 9] = tform[1][2];
+    data[i + 10] = tform[2][2];
+    data[i + 11] = tform[3][2];
+}
 
-    skm->bone_tform_tex_data[i + 8] = upfloat(tform[2][0]);
-    skm->bone_tform_tex_data[i + 9] = upfloat(tform[2][1]);
-    skm->bone_tform_tex_data[i + 10] = upfloat(tform[2][2]);
-    skm->bone_tform_tex_data[i + 11] = upfloat(tform[2][3]);
+// a * b for column-major 4x4 affine matrices (the cglm layout), written to
+// dest as the top three rows of the result (the palette layout). None of the
+// pointers need to be aligned. Each column of the result is a linear
+// combination of the columns of a, weighted by the matching column of b.
+static inline void
+skm_palette_mul(float *dest, const float *a, const float *b) {
+#ifdef SKM_USE_SSE
+    __m128 a0 = _mm_loadu_ps(a + 0);
+    __m128 a1 = _mm_loadu_ps(a + 4);
+    __m128 a2 = _mm_loadu_ps(a + 8);
+    __m128 a3 = _mm_loadu_ps(a + 12);
+
+    __m128 c[4];
+    for(size_t col = 0; col < 4; ++col) {
+        const float *bc = b + col * 4;
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+        c[col] = r;
+    }
 
-    skm->bone_tform_tex_data[i + 12] = upfloat(tform[3][0]);
-    skm->bone_tform_tex_data[i + 13] = upfloat(tform[3][1]);
-    skm->bone_tform_tex_data[i + 14] = upfloat(tform[3][2]);
-    skm->bone_tform_tex_data[i + 15] = upfloat(tform[3][3]);
+    // Columns to rows; the last row is (0, 0, 0, 1) and gets dropped.
+    _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+    _mm_storeu_ps(dest + 0, c[0]);
+    _mm_storeu_ps(dest + 4, c[1]);
+    _mm_storeu_ps(dest + 8, c[2]);
+#else
+    for(size_t col = 0; col < 4; ++col) {
+        const float *bc = b + col * 4;
+        for(size_t row = 0; row < 3; ++row) {
+            dest[row * 4 + col] = a[0 + row] * bc[0]
+                + a[4 + row] * bc[1]
+                + a[8 + row] * bc[2]
+                + a[12 + row] * bc[3];
+        }
+    }
+#endif
+}
+
+void
+skm_build_palette(struct skm_instance *inst) {
+    // skm_palette_mul writes the products in the texture layout (see
+    // skm_set_bone_global_transform), so they go straight into the upload
+    // buffer.
+    float *out = inst->bone_tform_tex_data;
+    const float *pose = (const float*)inst->bone_pose;
+    const float *inverse_bind = (const float*)inst->skm->bone_inverse_bind;
+
+    if(inst->skm->skinning == SKM_SKIN_DUAL_QUAT) {
+        for(size_t i = 0; i < inst->skm->bone_count; ++i) {
+            mat4 tform;
+            glm_mat4_mul(inst->bone_pose[i], inst->skm->bone_inverse_bind[i], tform);
+            skm_palette_dual_quat(out + i * SKM_DQ_PALETTE_TEXELS * 4, tform);
+        }
+    }
+    else {
+        for(size_t i = 0; i < inst->skm->bone_count; ++i) {
+            skm_palette_mul(out + i * SKM_PALETTE_FLOATS, pose + i * 16, inverse_bind + i * 16);
+        }
+    }
+
+    struct skm_palette_atlas *atlas = inst->atlas;
+    if(atlas) {
+        size_t end = inst->palette_row + inst->skm->bone_count;
+        if(inst->palette_row < atlas->dirty_first) atlas->dirty_first = inst->palette_row;
+        if(end > atlas->dirty_end) atlas->dirty_end = end;
+    }
+}
+
+size_t
+skm_palette_texels(const struct skeletal_mesh *skm) {
+    return skm->skinning == SKM_SKIN_DUAL_QUAT ? SKM_DQ_PALETTE_TEXELS : SKM_PALETTE_TEXELS;
 }
 
-/**
- * Uploads the current bone_tform_tex_data to opengl.
- */
 void
-skm_gl_upload_bone_tform(struct skeletal_mesh *skm) {
-    REPORT(glBindTexture(GL_TEXTURE_2D, skm->bone_tform_tex));
+skm_palette_atlas_init(struct skm_palette_atlas *atlas, size_t rows, size_t texels_per_bone) {
+    atlas->tex = 0;
+    atlas->texels_per_bone = texels_per_bone;
+    atlas->data = eng_zalloc(sizeof(float) * 4 * texels_per_bone * rows);
+    atlas->rows = rows;
+    atlas->rows_used = 0;
+    atlas->dirty_first = rows;
+    atlas->dirty_end = 0;
+}
+
+bool
+skm_palette_atlas_gl_init(struct skm_palette_atlas *atlas) {
+    GLint max_size = 0;
+    REPORT(glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size));
+    if(atlas->rows > (size_t)max_size) {
+        SDL_Log("skm_palette_atlas_gl_init: %zu rows is more than GL_MAX_TEXTURE_SIZE (%d)", atlas->rows, max_size);
+        return false;
+    }
+
+    REPORT(glGenTextures(1, &atlas->tex));
+
+    REPORT(glBindTexture(GL_TEXTURE_2D, atlas->tex));
+    REPORT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    REPORT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+
+    REPORT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    REPORT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
 
     // TODO:
     // It appears WebGL 1 does support RGBA32F.
@@ -327,11 +1176,81 @@ skm_gl_upload_bone_tform(struct skeletal_mesh *skm) {
     internal_format = GL_RGBA32F;
     #endif
 
+    // This is the only time the texture storage is specified; after this it
+    // is only ever updated in place.
     REPORT(glTexImage2D(GL_TEXTURE_2D, 0,
         internal_format,
-        // width of 4 px, height of bone count
-        4, (GLsizei)skm->bone_count,
+        // width of texels_per_bone px, height of the row count
+        (GLsizei)atlas->texels_per_bone, (GLsizei)atlas->rows,
         0,
         GL_RGBA, GL_FLOAT,
-        skm->bone_tform_tex_data));
-}
\ No newline at end of file
+        atlas->data));
+
+    atlas->dirty_first = atlas->rows;
+    atlas->dirty_end = 0;
+    return true;
+}
+
+void
+skm_palette_atlas_free(struct skm_palette_atlas *atlas) {
+    eng_free(atlas->data, sizeof(float) * 4 * atlas->texels_per_bone * atlas->rows);
+    atlas->data = NULL;
+    atlas->rows = 0;
+    atlas->rows_used = 0;
+
+    if(atlas->tex) {
+        REPORT(glDeleteTextures(1, &atlas->tex));
+        atlas->tex = 0;
+    }
+}
+
+bool
+skm_palette_atlas_add(struct skm_palette_atlas *atlas, struct skm_instance *inst) {
+    size_t bone_count = inst->skm->bone_count;
+    size_t floats = 4 * atlas->texels_per_bone;
+    if(inst->atlas) return inst->atlas == atlas;
+
+    if(skm_palette_texels(inst->skm) != atlas->texels_per_bone) {
+        SDL_Log("skm_palette_atlas_add: the mesh needs %zu texels per bone, the atlas has %zu",
+            skm_palette_texels(inst->skm), atlas->texels_per_bone);
+        return false;
+    }
+
+    if(atlas->rows - atlas->rows_used < bone_count) {
+        SDL_Log("skm_palette_atlas_add: no room for %zu more bones (%zu/%zu rows used)",
+            bone_count, atlas->rows_used, atlas->rows);
+        return false;
+    }
+
+    float *rows = atlas->data + atlas->rows_used * floats;
+    memcpy(rows, inst->bone_tform_tex_data, sizeof(float) * floats * bone_count);
+    eng_free(inst->bone_tform_tex_data, sizeof(float) * floats * bone_count);
+
+    inst->bone_tform_tex_data = rows;
+    inst->atlas = atlas;
+    inst->palette_row = atlas->rows_used;
+
+    atlas->rows_used += bone_count;
+    return true;
+}
+
+void
+skm_palette_atlas_upload(struct skm_palette_atlas *atlas) {
+    if(atlas->dirty_end <= atlas->dirty_first) return;
+
+    // The dirty range is a single span covering every rebuilt palette. The
+    // instances that animate every frame are usually most of the atlas, so
+    // that beats one call per instance.
+    size_t first = atlas->dirty_first;
+    size_t count = atlas->dirty_end - atlas->dirty_first;
+
+    REPORT(glBindTexture(GL_TEXTURE_2D, atlas->tex));
+    REPORT(glTexSubImage2D(GL_TEXTURE_2D, 0,
+        0, (GLint)first,
+        (GLsizei)atlas->texels_per_bone, (GLsizei)count,
+        GL_RGBA, GL_FLOAT,
+        atlas->data + first * 4 * atlas->texels_per_bone));
+
+    atlas->dirty_first = atlas->rows;
+    atlas->dirty_end = 0;
+}
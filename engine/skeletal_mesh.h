@@ -4,6 +4,41 @@
 #include "our_gl.h"
 #include <cglm/cglm.h>
 
+/* How the vertex shader blends the bones of a vertex. */
+enum skm_skinning {
+    /* Weighted sum of the bone matrices. */
+    SKM_SKIN_LINEAR = 0,
+
+    /* Weighted sum of unit dual quaternions, which doesn't collapse joints
+     * the way blending matrices does, and needs less palette data. Bones
+     * must not be scaled. Needs skel-dq-vert.glsl. */
+    SKM_SKIN_DUAL_QUAT,
+};
+
+/* The vertex format the GPU gets: 24 bytes, where the float vertices kept in
+ * skeletal_mesh.vertices (SKEL_MESH_4BYTES_COUNT floats) are 64. */
+struct skm_packed_vertex {
+    /* snorm16, multiplied by skeletal_mesh.position_scale in the shader.
+     * The fourth one is padding. */
+    int16_t position[4];
+
+    /* snorm8, and padding. */
+    int8_t normal[4];
+
+    /* Bone indices, so at most 256 bones. */
+    uint8_t bone[4];
+
+    /* unorm8, rounded so that they add up to exactly 255. */
+    uint8_t weight[4];
+
+    /* unorm16, so texture coordinates must be in [0, 1]; anything else is
+     * clamped, and skm_pack_vertices logs it. */
+    uint16_t uv[2];
+};
+
+/* The shared, read-only part of a skinned mesh: vertices, GL buffers and the
+ * skeleton. Everything that changes while a character animates lives in a
+ * struct skm_instance, so any number of characters can use one mesh. */
 struct skeletal_mesh {
     float *vertices;
     size_t vertices_count;
@@ -13,25 +48,84 @@ struct skeletal_mesh {
 
     GLuint shader;
 
-    GLuint bone_tform_tex;
-    float *bone_tform_tex_data;
+    /* Locations of u_skeleton_row and u_pos_scale in shader, found by
+     * skm_gl_init. */
+    GLint skeleton_row_uniform;
+    GLint pos_scale_uniform;
+
+    /* What the packed positions are multiplied by; set by skm_gl_upload. */
+    float position_scale;
 
     GLuint array_buf;
     GLuint element_buf;
 
+    /* GL_UNSIGNED_SHORT when the mesh has few enough vertices (see
+     * ourgl_index_type), set by skm_gl_upload. triangles stays 32-bit. */
+    GLenum index_type;
+
     mat4 *bone_inverse_bind;
-    mat4 *bone_pose;
-    mat4 *bone_local_pose;
 
-    bool *bone_compute_graph;
+    /* The rest pose, which new instances start out in. */
+    mat4 *bone_local_pose;
 
+    /* The parent of each bone, or -1 for roots. Parents always come before
+     * their children (bone_heirarchy[i] < i); the importer sorts the bones
+     * that way. */
     int32_t *bone_heirarchy;
 
     size_t bone_count;
 
+    /* Pick this before making any instances; their palettes depend on it. */
+    enum skm_skinning skinning;
+
     void *import_key;
 };
 
+/* Bone matrices are affine, so the palette only keeps their top three rows:
+ * a bone is SKM_PALETTE_TEXELS RGBA texels, texel k holding row k of its
+ * matrix. */
+#define SKM_PALETTE_TEXELS 3
+#define SKM_PALETTE_FLOATS (SKM_PALETTE_TEXELS * 4)
+
+/* With SKM_SKIN_DUAL_QUAT a bone is two texels: the real part of its dual
+ * quaternion (the rotation), then the dual part. Both are x, y, z, w. */
+#define SKM_DQ_PALETTE_TEXELS 2
+
+/* A single texture holding the skinning palettes of many instances, one bone
+ * per row (texels_per_bone RGBA32F texels). The texture is allocated once;
+ * after that only the rows that were rebuilt since the last upload are sent,
+ * in one glTexSubImage2D. Rows are handed out in order and never reclaimed. */
+struct skm_palette_atlas {
+    GLuint tex;
+
+    /* SKM_PALETTE_TEXELS or SKM_DQ_PALETTE_TEXELS. Only meshes with that
+     * layout can use the atlas. */
+    size_t texels_per_bone;
+
+    float *data;
+    size_t rows;
+    size_t rows_used;
+
+    /* Rows [dirty_first, dirty_end) need uploading. */
+    size_t dirty_first;
+    size_t dirty_end;
+};
+
+/* One character drawn with a skeletal_mesh: its pose, and the skinning
+ * palette built from that pose. */
+struct skm_instance {
+    struct skeletal_mesh *skm;
+
+    mat4 *bone_local_pose;
+    mat4 *bone_pose;
+
+    /* bone_count * skm_palette_texels(skm) * 4 floats. Once the instance is
+     * in an atlas this points at its rows there, starting at palette_row. */
+    float *bone_tform_tex_data;
+    struct skm_palette_atlas *atlas;
+    size_t palette_row;
+};
+
 struct skm_vec3_key {
     float time;
     vec3 value;
@@ -64,17 +158,15 @@ struct skm_arm_anim_bone_playback {
     size_t position_idx;
     size_t scale_idx;
     size_t rotation_idx;
+};
 
-    vec3 position;
-    vec3 scale;
-    versor rotation;
+/* Local-space transforms for every bone of a skeleton. */
+struct skm_pose {
+    size_t bone_count;
 
-    // Just store the various matrices directly in our playback state. That way,
-    // for any channel with only a single key, we can simply never update the
-    // matrix.
-   // mat4 position_matrix;
-   // mat4 scale_matrix;
-    //mat4 rotation_matrix;
+    vec3 *position;
+    versor *rotation;
+    vec3 *scale;
 };
 
 struct skm_armature_anim_playback {
@@ -82,6 +174,90 @@ struct skm_armature_anim_playback {
 
     struct skm_arm_anim_bone_playback *state;
     float time;
+
+    /* The animation sampled at time. */
+    struct skm_pose pose;
+
+    /* If loop_end > loop_start, stepping past loop_end wraps the time back
+     * around to loop_start. */
+    float loop_start;
+    float loop_end;
+
+    /* Set when time has moved since pose was last sampled. */
+    bool stale;
+};
+
+/* Counts how much animation work has been done since the last
+ * skm_anim_stats_reset(). Only samples a tick takes (seek, sample) count;
+ * setting up playbacks and baking clips don't. */
+struct skm_anim_stats {
+    size_t playbacks_sampled;
+    size_t bones_sampled;
+};
+
+extern struct skm_anim_stats skm_anim_stats;
+
+/* One input to skm_pose_blend or skm_pose_add. */
+struct skm_pose_layer {
+    struct skm_pose *pose;
+    float weight;
+
+    /* Optional per-bone factor for weight, e.g. 0 for the legs and 1 for the
+     * upper body. NULL applies the layer to every bone. */
+    const float *mask;
+};
+
+/* One channel (position, rotation or scale) of every bone of a clip, packed
+ * into shared arrays. The keys of bone i are keys first[i] up to (but not
+ * including) first[i] + count[i]. */
+struct skm_soa_channel {
+    uint32_t *first;
+    uint32_t *count;
+
+    float *times;
+
+    /* components floats per key: 3 for position and scale, 4 for rotation. */
+    float *values;
+    size_t components;
+    size_t key_count;
+};
+
+/* The same data as a skm_armature_anim, but laid out per channel rather than
+ * per bone, so that skm_soa_clip_sample can work on several bones at once. */
+struct skm_soa_clip {
+    size_t bone_count;
+    float length;
+
+    struct skm_soa_channel position;
+    struct skm_soa_channel rotation;
+    struct skm_soa_channel scale;
+};
+
+/* A clip resampled at a fixed frame rate, with every bone keyed on every
+ * frame, and quantized:
+ *  - rotations as "smallest three" quaternions in 48 bits: the index of the
+ *    largest component in 2 bits and the other three in 15 bits each (the
+ *    largest is made positive and rebuilt from the unit length),
+ *  - positions and scales as 16 bits per component, relative to the range
+ *    that bone's channel covers over the clip.
+ * Frames are stored one after the other, all bones of a frame together, so
+ * sampling reads two small contiguous blocks and needs no key search. */
+struct skm_quantized_clip {
+    size_t bone_count;
+    float length;
+    float frame_rate;
+    size_t frame_count;
+
+    /* frame_count * bone_count entries of 3 uint16_t each. */
+    uint16_t *rotation;
+    uint16_t *position;
+    uint16_t *scale;
+
+    /* Per bone: decoded = min + (value / 65535) * extent. */
+    vec3 *position_min;
+    vec3 *position_extent;
+    vec3 *scale_min;
+    vec3 *scale_extent;
 };
 
 void skm_init(struct skeletal_mesh *skm, float *vertices, size_t vertices_count, GLuint *triangles, size_t triangles_count, GLuint shader);
@@ -92,35 +268,196 @@ void skm_init(struct skeletal_mesh *skm, float *vertices, size_t vertices_count,
 void skm_gl_init(struct skeletal_mesh *skm);
 
 /**
- * Re-uploads the vertex data for the given mesh.
+ * Packs the vertex data for the given mesh (see skm_pack_vertices) and
+ * re-uploads it.
  */
 void skm_gl_upload(struct skeletal_mesh *skm);
 
 /**
- * Draws the skeletal mesh using opengl.
+ * Converts vertex_count float vertices (SKEL_MESH_4BYTES_COUNT floats each)
+ * to the packed format, and returns the scale to multiply the packed
+ * positions by.
+ */
+float skm_pack_vertices(const float *vertices, size_t vertex_count, struct skm_packed_vertex *out);
+
+/**
+ * Binds the mesh's vertex buffer and points the vertex attributes at the
+ * packed format. A shader drawing it needs u_pos_scale set to position_scale.
+ */
+void skm_gl_bind_vertices(struct skeletal_mesh *skm);
+
+/**
+ * Draws count instances of the skeletal mesh using opengl. The vertex buffer,
+ * attributes, shader and palette atlas are set up once; only the palette row
+ * changes between instances, which must all be in the same atlas.
  */
-void skm_gl_draw(struct skeletal_mesh *skm);
+void skm_gl_draw_instances(struct skeletal_mesh *skm, struct skm_instance *instances, size_t count);
+
+/**
+ * Draws a single instance. Prefer skm_gl_draw_instances for crowds.
+ */
+void skm_gl_draw(struct skm_instance *inst);
 
 void skm_destroy(struct skeletal_mesh *skm);
 
-void skm_compute_matrices(struct skeletal_mesh *skm, mat4 root_pose);
+/**
+ * Sets up an instance of skm in its rest pose. skm must outlive it.
+ */
+void skm_instance_init(struct skm_instance *inst, struct skeletal_mesh *skm);
+
+void skm_instance_free(struct skm_instance *inst);
+
+/**
+ * How many texels one bone of skm takes up in a palette.
+ */
+size_t skm_palette_texels(const struct skeletal_mesh *skm);
+
+/**
+ * Allocates an atlas with room for rows bones, each texels_per_bone texels
+ * (see skm_palette_texels).
+ */
+void skm_palette_atlas_init(struct skm_palette_atlas *atlas, size_t rows, size_t texels_per_bone);
+
+/**
+ * Creates the atlas texture at its full size. Needs a GL context. Returns
+ * false if the texture would be taller than GL_MAX_TEXTURE_SIZE.
+ */
+bool skm_palette_atlas_gl_init(struct skm_palette_atlas *atlas);
+
+void skm_palette_atlas_free(struct skm_palette_atlas *atlas);
+
+/**
+ * Moves the palette of inst into the next free rows of the atlas. Returns
+ * false if the atlas is full or has a different layout, in which case inst
+ * keeps its own palette (and can't be drawn).
+ */
+bool skm_palette_atlas_add(struct skm_palette_atlas *atlas, struct skm_instance *inst);
+
+/**
+ * Uploads the rows that changed since the last upload, if any. One call per
+ * frame covers every instance in the atlas.
+ */
+void skm_palette_atlas_upload(struct skm_palette_atlas *atlas);
+
+/**
+ * Computes bone_pose from bone_local_pose in a single pass over the bones.
+ */
+void skm_compute_matrices(struct skm_instance *inst, mat4 root_pose);
 
 void skm_arm_playback_init(struct skm_armature_anim_playback *playback, struct skm_armature_anim *anim);
 
-void skm_arm_playback_apply(struct skm_armature_anim_playback *playback);
+void skm_arm_playback_free(struct skm_armature_anim_playback *playback);
+
+/**
+ * Writes the playback's current pose into the bone_local_pose of inst.
+ */
+void skm_arm_playback_apply(struct skm_armature_anim_playback *playback, struct skm_instance *inst);
+
+/**
+ * Makes the playback loop between start and end while stepping. Pass
+ * start == end to disable looping.
+ */
+void skm_arm_playback_set_loop(struct skm_armature_anim_playback *playback, float start, float end);
 
+/**
+ * Advances the playback's time (including looping) without sampling it. This
+ * is all a playback needs while nothing is looking at it: it stays in sync,
+ * and the next skm_arm_playback_sample picks up from there.
+ */
+void skm_arm_playback_advance(struct skm_armature_anim_playback *playback, float step);
+
+/**
+ * Brings the playback's pose up to date with its time, if it isn't already.
+ * The key cursors move forward from their current position, so this is cheap
+ * when it is done every tick.
+ */
+void skm_arm_playback_sample(struct skm_armature_anim_playback *playback);
+
+/**
+ * skm_arm_playback_advance followed by skm_arm_playback_sample.
+ */
 void skm_arm_playback_step(struct skm_armature_anim_playback *playback, float step);
 
+void skm_anim_stats_reset(void);
+
 void skm_arm_playback_seek(struct skm_armature_anim_playback *playback, float time);
 
+void skm_pose_init(struct skm_pose *pose, size_t bone_count);
+void skm_pose_free(struct skm_pose *pose);
+void skm_pose_copy(struct skm_pose *dest, struct skm_pose *src);
+
+/**
+ * Weighted blend of any number of poses into out (which may be one of the
+ * inputs). Weights are normalized per bone, after applying the masks; bones
+ * that end up with no weight at all take the first layer's transform.
+ * Rotations are blended with a normalized weighted sum (nlerp).
+ */
+void skm_pose_blend(struct skm_pose *out, const struct skm_pose_layer *layers, size_t count);
+
+/**
+ * Makes an additive pose: the difference that takes reference to pose.
+ */
+void skm_pose_make_additive(struct skm_pose *out, struct skm_pose *pose, struct skm_pose *reference);
+
+/**
+ * Applies an additive pose (from skm_pose_make_additive) on top of pose, with
+ * the layer's weight and mask.
+ */
+void skm_pose_add(struct skm_pose *pose, const struct skm_pose_layer *additive);
+
+/**
+ * Builds the local matrix (translation * rotation * scale) of every bone of
+ * the pose. This is the only place matrices are made, so it should run once
+ * per mesh per frame, after all the blending.
+ */
+void skm_pose_compose(struct skm_pose *pose, mat4 *local_matrices);
+
+/**
+ * Builds a SoA clip holding the same keys as anim.
+ */
+void skm_soa_clip_init(struct skm_soa_clip *clip, struct skm_armature_anim *anim);
+void skm_soa_clip_free(struct skm_soa_clip *clip);
+
+/**
+ * Samples every bone of the clip at the given time into pose, interpolating
+ * positions and scales linearly and rotations with nlerp. cursors holds three
+ * key indices per bone (position, rotation, scale) which are used as search
+ * hints and updated, the same way the playback cursors are; start them at 0.
+ */
+void skm_soa_clip_sample(struct skm_soa_clip *clip, uint32_t *cursors, float time, struct skm_pose *pose);
+
+/**
+ * Resamples anim at frame_rate frames per second and quantizes the result.
+ * This can be done once at load time; the source animation is not needed
+ * afterwards.
+ */
+void skm_quantized_clip_init(struct skm_quantized_clip *clip, struct skm_armature_anim *anim, float frame_rate);
+void skm_quantized_clip_free(struct skm_quantized_clip *clip);
+
+/**
+ * Samples every bone of the clip at the given time (clamped to the clip)
+ * into pose, interpolating between the two nearest frames.
+ */
+void skm_quantized_clip_sample(struct skm_quantized_clip *clip, float time, struct skm_pose *pose);
+
+/**
+ * How many bytes the keys of a clip take up, for comparing layouts.
+ */
+size_t skm_anim_key_bytes(struct skm_armature_anim *anim);
+size_t skm_quantized_clip_bytes(struct skm_quantized_clip *clip);
+
 /** 
  * Updates the bone_tform_tex_data with the given matrisx. 
  */
-void skm_set_bone_global_transform(struct skeletal_mesh *skm, int index, mat4 tform);
+void skm_set_bone_global_transform(struct skm_instance *inst, int index, mat4 tform);
 
 /**
- * Uploads the current bone_tform_tex_data to opengl.
+ * Fills bone_tform_tex_data with bone_pose[i] * bone_inverse_bind[i] for every
+ * bone, which is what the shader needs to skin the mesh, and marks the rows
+ * dirty in the instance's atlas. With SKM_SKIN_DUAL_QUAT the products are
+ * converted to dual quaternions here. Call it after skm_compute_matrices and before
+ * skm_palette_atlas_upload.
  */
-void skm_gl_upload_bone_tform(struct skeletal_mesh *skm);
+void skm_build_palette(struct skm_instance *inst);
 
 #endif
\ No newline at end of file
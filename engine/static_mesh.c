@@ -0,0 +1,203 @@
+#include "static_mesh.h"
+
+#include "alloc.h"
+
+#include "our_gl.h"
+
+#include <SDL3/SDL_video.h>
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+void
+stm_init(struct static_mesh *stm, float *vertices, size_t vertices_count, uint32_t *triangles, size_t triangles_count, GLuint shader) {
+    const size_t bytes = vertices_count * sizeof(*vertices);
+    stm->vertices = eng_zalloc(bytes);
+    memcpy(stm->vertices, vertices, bytes);
+    stm->vertices_count = vertices_count;
+
+    const size_t tbytes = triangles_count * sizeof(*triangles);
+    stm->triangles = eng_zalloc(tbytes);
+    memcpy(stm->triangles, triangles, tbytes);
+    stm->triangles_count = triangles_count;
+
+    stm->array_buf = 0;
+    stm->element_buf = 0;
+    stm->shader = shader;
+}
+
+void
+stm_gl_init(struct static_mesh *stm) {
+    REPORT(glGenBuffers(1, &stm->array_buf));
+    REPORT(glGenBuffers(1, &stm->element_buf));
+
+    stm->pos_scale_uniform = -1;
+    if(stm->shader) {
+        REPORT(stm->pos_scale_uniform = glGetUniformLocation(stm->shader, "u_pos_scale"));
+    }
+
+    stm_gl_upload(stm);
+}
+
+float
+stm_pack_vertices(const float *vertices, size_t vertex_count, struct stm_packed_vertex *out) {
+    float scale = 0.0f;
+    for(size_t i = 0; i < vertex_count; ++i) {
+        const float *v = vertices + i * STATIC_MESH_4BYTES_COUNT;
+        for(size_t k = 0; k < 3; ++k) scale = fmaxf(scale, fabsf(v[k]));
+    }
+    if(scale == 0.0f) scale = 1.0f;
+
+    bool warned = false;
+    for(size_t i = 0; i < vertex_count; ++i) {
+        const float *v = vertices + i * STATIC_MESH_4BYTES_COUNT;
+        struct stm_packed_vertex *p = &out[i];
+
+        for(size_t k = 0; k < 3; ++k) {
+            p->position[k] = (int16_t)lroundf(ourgl_clampf(v[k] / scale, -1.0f, 1.0f) * 32767.0f);
+            p->normal[k] = (int8_t)lroundf(ourgl_clampf(v[3 + k], -1.0f, 1.0f) * 127.0f);
+        }
+        p->position[3] = 0;
+        p->normal[3] = 0;
+
+        if(!ourgl_pack_uv(&v[6], p->uv) && !warned) {
+            SDL_Log("stm_pack_vertices: uv (%g, %g) is outside [0, 1], and gets clamped", v[6], v[7]);
+            warned = true;
+        }
+    }
+
+    return scale;
+}
+
+void
+stm_gl_upload(struct static_mesh *stm) {
+    size_t vertex_count = stm->vertices_count / STATIC_MESH_4BYTES_COUNT;
+    size_t bytes = sizeof(struct stm_packed_vertex) * vertex_count;
+
+    struct stm_packed_vertex *packed = eng_zalloc(bytes);
+    stm->position_scale = stm_pack_vertices(stm->vertices, vertex_count, packed);
+
+    REPORT(glBindBuffer(GL_ARRAY_BUFFER, stm->array_buf));
+    REPORT(glBufferData(GL_ARRAY_BUFFER, bytes, packed, GL_STATIC_DRAW));
+
+    eng_free(packed, bytes);
+
+    stm->index_type = ourgl_index_type(vertex_count);
+    size_t tbytes = ourgl_index_size(stm->index_type) * stm->triangles_count;
+
+    void *indices = stm->triangles;
+    if(stm->index_type == GL_UNSIGNED_SHORT) {
+        indices = eng_zalloc(tbytes);
+        ourgl_narrow_indices(stm->triangles, stm->triangles_count, indices);
+    }
+
+    REPORT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, stm->element_buf));
+    REPORT(glBufferData(GL_ELEMENT_ARRAY_BUFFER, tbytes, indices, GL_STATIC_DRAW));
+
+    if(indices != stm->triangles) eng_free(indices, tbytes);
+}
+
+void
+stm_gl_bind(struct static_mesh *stm) {
+    const GLsizei stride = sizeof(struct stm_packed_vertex);
+
+    REPORT(glBindBuffer(GL_ARRAY_BUFFER, stm->array_buf));
+    REPORT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, stm->element_buf));
+
+    REPORT(glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, stride, (void*)offsetof(struct stm_packed_vertex, position)));
+    REPORT(glEnableVertexAttribArray(0));
+
+    REPORT(glVertexAttribPointer(1, 3, GL_BYTE, GL_TRUE, stride, (void*)offsetof(struct stm_packed_vertex, normal)));
+    REPORT(glEnableVertexAttribArray(1));
+
+    // A skinned mesh drawn before us leaves these pointing at its buffer.
+    REPORT(glDisableVertexAttribArray(2));
+    REPORT(glDisableVertexAttribArray(3));
+
+    REPORT(glVertexAttribPointer(4, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(struct stm_packed_vertex, uv)));
+    REPORT(glEnableVertexAttribArray(4));
+
+    if(stm->shader) {
+        REPORT(glUseProgram(stm->shader));
+        REPORT(glUniform1f(stm->pos_scale_uniform, stm->position_scale));
+    }
+}
+
+void
+stm_gl_draw(struct static_mesh *stm) {
+    REPORT(glDrawElements(GL_TRIANGLES, stm->triangles_count, stm->index_type, 0));
+}
+
+// Neither is in GL 2 / GLES 2, which is all glad and the emscripten headers
+// give us, so they're looked up by hand.
+typedef void (APIENTRY *stm_draw_elements_instanced_fn)(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances);
+typedef void (APIENTRY *stm_vertex_attrib_divisor_fn)(GLuint index, GLuint divisor);
+
+static stm_draw_elements_instanced_fn stm_draw_elements_instanced = NULL;
+static stm_vertex_attrib_divisor_fn stm_vertex_attrib_divisor = NULL;
+
+bool
+stm_gl_load_instancing(void) {
+    static const char *suffixes[] = { "", "ARB", "ANGLE", "EXT" };
+
+    for(size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+        char draw_name[64], divisor_name[64];
+        snprintf(draw_name, sizeof(draw_name), "glDrawElementsInstanced%s", suffixes[i]);
+        snprintf(divisor_name, sizeof(divisor_name), "glVertexAttribDivisor%s", suffixes[i]);
+
+        // Only a matching pair will do: the two have to come from the same
+        // extension to work together.
+        stm_draw_elements_instanced = (stm_draw_elements_instanced_fn)SDL_GL_GetProcAddress(draw_name);
+        stm_vertex_attrib_divisor = (stm_vertex_attrib_divisor_fn)SDL_GL_GetProcAddress(divisor_name);
+        if(stm_draw_elements_instanced && stm_vertex_attrib_divisor) {
+            SDL_Log("static mesh: instancing through %s", draw_name);
+            return true;
+        }
+    }
+
+    stm_draw_elements_instanced = NULL;
+    stm_vertex_attrib_divisor = NULL;
+    SDL_Log("static mesh: no instanced drawing, falling back to a draw per copy");
+    return false;
+}
+
+void
+stm_gl_draw_instanced(struct static_mesh *stm, GLuint instance_buf, const struct stm_instance *instances, size_t count) {
+    if(count == 0 || !stm_draw_elements_instanced) return;
+
+    REPORT(glBindBuffer(GL_ARRAY_BUFFER, instance_buf));
+    REPORT(glBufferData(GL_ARRAY_BUFFER, sizeof(*instances) * count, instances, GL_STREAM_DRAW));
+
+    REPORT(glVertexAttribPointer(STM_INSTANCE_ATTRIB, 4, GL_FLOAT, GL_FALSE, sizeof(*instances), (void*)0));
+    REPORT(glEnableVertexAttribArray(STM_INSTANCE_ATTRIB));
+    REPORT(stm_vertex_attrib_divisor(STM_INSTANCE_ATTRIB, 1));
+
+    REPORT(stm_draw_elements_instanced(GL_TRIANGLES, stm->triangles_count, stm->index_type, 0, (GLsizei)count));
+
+    // Everything else is drawn without instancing, and a leftover divisor
+    // would apply to whatever ends up on this attribute next.
+    REPORT(stm_vertex_attrib_divisor(STM_INSTANCE_ATTRIB, 0));
+    REPORT(glDisableVertexAttribArray(STM_INSTANCE_ATTRIB));
+}
+
+void
+stm_destroy(struct static_mesh *stm) {
+    eng_free(stm->vertices, stm->vertices_count * sizeof(*stm->vertices));
+    stm->vertices = NULL;
+    stm->vertices_count = 0;
+
+    eng_free(stm->triangles, stm->triangles_count * sizeof(*stm->triangles));
+    stm->triangles = NULL;
+    stm->triangles_count = 0;
+
+    if(stm->array_buf) {
+        REPORT(glDeleteBuffers(1, &stm->array_buf));
+    }
+    if(stm->element_buf) {
+        REPORT(glDeleteBuffers(1, &stm->element_buf));
+    }
+    stm->array_buf = 0;
+    stm->element_buf = 0;
+}
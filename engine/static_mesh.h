@@ -0,0 +1,127 @@
+#ifndef ENGINE_STATIC_MESH_H
+#define ENGINE_STATIC_MESH_H
+
+#include "our_gl.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// How many things we put in each vertex: position, normal, uv.
+#define STATIC_MESH_4BYTES_COUNT 8
+
+/* The vertex format the GPU gets: 16 bytes, where a skinned vertex is 24.
+ * Same encoding as skm_packed_vertex, minus the bones. */
+struct stm_packed_vertex {
+    /* snorm16, multiplied by static_mesh.position_scale in the shader. The
+     * fourth one is padding. */
+    int16_t position[4];
+
+    /* snorm8, and padding. */
+    int8_t normal[4];
+
+    /* unorm16, so texture coordinates must be in [0, 1]; anything else is
+     * clamped, and stm_pack_vertices logs it. */
+    uint16_t uv[2];
+};
+
+/* Where stm_gl_draw_instanced puts one copy of a mesh: scaled uniformly,
+ * rotated around y, then moved to (x, y, 0). This is a_instance in
+ * static-inst-vert.glsl. */
+struct stm_instance {
+    float x;
+    float y;
+    float rotation;
+    float scale;
+};
+
+/* Where ourgl_compile_shader binds a_instance. */
+#define STM_INSTANCE_ATTRIB 5
+
+/* A mesh that never deforms, like the props. It has no bones and no weights,
+ * neither on the CPU nor on the GPU, so it is drawn with a plain model
+ * matrix instead of a palette. */
+struct static_mesh {
+    /* STATIC_MESH_4BYTES_COUNT floats per vertex. */
+    float *vertices;
+    size_t vertices_count;
+
+    uint32_t *triangles;
+    size_t triangles_count;
+
+    GLuint shader;
+
+    /* Location of u_pos_scale in shader, found by stm_gl_init. */
+    GLint pos_scale_uniform;
+
+    /* What the packed positions are multiplied by; set by stm_gl_upload. */
+    float position_scale;
+
+    GLuint array_buf;
+    GLuint element_buf;
+
+    /* GL_UNSIGNED_SHORT when the mesh has few enough vertices (see
+     * ourgl_index_type), set by stm_gl_upload. triangles stays 32-bit. */
+    GLenum index_type;
+
+    void *import_key;
+};
+
+/**
+ * Copies the given vertices (STATIC_MESH_4BYTES_COUNT floats each) and
+ * triangles into stm.
+ */
+void stm_init(struct static_mesh *stm, float *vertices, size_t vertices_count, uint32_t *triangles, size_t triangles_count, GLuint shader);
+
+/**
+ * Creates the GL state necessary to render the given static mesh.
+ */
+void stm_gl_init(struct static_mesh *stm);
+
+/**
+ * Packs the vertex data for the given mesh (see stm_pack_vertices) and
+ * re-uploads it.
+ */
+void stm_gl_upload(struct static_mesh *stm);
+
+/**
+ * Converts vertex_count float vertices (STATIC_MESH_4BYTES_COUNT floats each)
+ * to the packed format, and returns the scale to multiply the packed
+ * positions by.
+ */
+float stm_pack_vertices(const float *vertices, size_t vertex_count, struct stm_packed_vertex *out);
+
+/**
+ * Binds the mesh's buffers and shader, points the vertex attributes at the
+ * packed format and sets u_pos_scale. The bone attributes are disabled, so
+ * nothing is fetched for them. Anything else the shader needs (u_m, ...) is
+ * up to the caller, between this and stm_gl_draw.
+ */
+void stm_gl_bind(struct static_mesh *stm);
+
+/**
+ * Draws the mesh with whatever stm_gl_bind set up. Call it once per copy,
+ * changing u_m in between.
+ */
+void stm_gl_draw(struct static_mesh *stm);
+
+/**
+ * Looks up glDrawElementsInstanced and glVertexAttribDivisor, or their ARB or
+ * ANGLE (WebGL 1) versions. Returns false if the context has none of them,
+ * in which case stm_gl_draw_instanced can't be used. Needs a GL context.
+ */
+bool stm_gl_load_instancing(void);
+
+/**
+ * Draws count copies of the mesh in a single call, after stm_gl_bind. The
+ * instances are streamed into instance_buf, and the shader has to place
+ * them from a_instance (like static-inst-vert.glsl does).
+ */
+void stm_gl_draw_instanced(struct static_mesh *stm, GLuint instance_buf, const struct stm_instance *instances, size_t count);
+
+/**
+ * Frees the mesh's data, and its GL buffers if stm_gl_init made any (which
+ * then needs a GL context).
+ */
+void stm_destroy(struct static_mesh *stm);
+
+#endif
@@ -1,6 +1,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "model.h"
 #include "our_gl.h"
 
 #include <SDL3/SDL_log.h>
@@ -0,0 +1,618 @@
+#include "level.h"
+
+#include "engine/alloc.h"
+
+#include <SDL3/SDL_log.h>
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+// The random numbers for a cell come from hashing its coordinates, rather
+// than from rand(), so a bale looks the same no matter which order (or
+// thread) the cells are meshed in, or how often its chunk is rebuilt. Each
+// number a cell needs has its own salt.
+enum {
+    CELL_SALT_OFF_X,
+    CELL_SALT_OFF_Y,
+    CELL_SALT_OFF_Z,
+    CELL_SALT_ROLL,
+    CELL_SALT_TURN,
+    CELL_SALT_TILT,
+};
+
+// Mixes the coordinates and salt together (the finalizer from murmur3), so
+// that neighbouring cells get unrelated values.
+static uint32_t
+cell_hash(int32_t x, int32_t y, uint32_t salt) {
+    uint32_t h = (uint32_t)x * 0x8da6b343u ^ (uint32_t)y * 0xd8163841u ^ salt * 0xcb1ab31fu;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
+}
+
+// used to make the hay look slightly more interesting.
+static float
+nudge(int32_t x, int32_t y, uint32_t salt) {
+    // PROBLEM: The hay mesh has several vertices at each corner, with
+    // different normals and uvs (the import welds the ones that are fully
+    // identical, but these aren't), so nudging vertices one at a time would
+    // tear the bale open.
+
+    // 24 bits, so it fits a float exactly.
+    float r = (float)(cell_hash(x, y, salt) >> 8) / (float)(1 << 24);
+
+    // up to 5 thousandths in any direction.
+    return (r - 0.5) / 1000.0;
+}
+
+static float
+rand_angle(int32_t x, int32_t y, uint32_t salt) {
+    // One of four quarter turns, from the top two bits.
+    int r = cell_hash(x, y, salt) >> 30;
+    return r * 6.28 * 0.25;
+}
+
+// Where the bale in cell (x, y) goes: turned to a random side, tilted a little
+// and moved to the cell. Always the same for the same cell.
+static void
+hay_cell_tform(int x, int y, mat4 cube_tform) {
+    float off_x = x * LEVEL_CELL_SIZE + nudge(x, y, CELL_SALT_OFF_X);
+    float off_y = y * LEVEL_CELL_SIZE + nudge(x, y, CELL_SALT_OFF_Y);
+    float off_z = nudge(x, y, CELL_SALT_OFF_Z);
+
+    // Unless we nudge all the vertices that are at thes ame location (but that
+    // have different normals?) by the same amount, we can't do the nugding. but
+    // we can nudge entire cubes.
+
+    glm_rotate_make(cube_tform, rand_angle(x, y, CELL_SALT_ROLL), (vec3){ 0, 0, 1 });
+    glm_rotated(cube_tform, rand_angle(x, y, CELL_SALT_TURN) + nudge(x, y, CELL_SALT_TILT) * 250, (vec3){ 0, 1, 0 });
+    glm_translated(cube_tform, (vec3){ off_x, off_y, off_z });
+}
+
+// --- hidden faces ---
+//
+// A bale's faces are numbered like the directions +x, -x, +y, -y, +z, -z
+// (axis * 2, plus one if negative). The bale is a bumpy cube, so a triangle
+// is on a face if all of it is near that side of the cube; the ones on the
+// corners are on two or three.
+//
+// The map is in the x/y plane (gravity is -y) and the camera always looks
+// down -z from in front of it, so everything here relies on that fixed view.
+// Whichever face ends up pointing away from the camera (-z) is never seen.
+// A face pointing at a neighbouring bale is hidden too, but only towards the
+// back: bales are tilted a little, so the front of the gap between two of
+// them opens up, and the front of each face stays visible through it.
+
+// How near the side of the cube (as a fraction of how far the bale reaches in
+// that direction) a triangle has to be to count as on that face.
+#define LEVEL_FACE_DEPTH 0.9f
+
+// How far towards the camera (from the middle of the bale, as a fraction of
+// how far it reaches that way) a triangle facing a neighbour can reach and
+// still be hidden by it.
+#define LEVEL_HIDDEN_DEPTH 0.15f
+
+#define LEVEL_ALL_FACES 0x3f
+
+// Which face of the bale tform turns towards which world direction.
+static void
+hay_face_directions(mat4 tform, int directions[6]) {
+    for(int face = 0; face < 6; ++face) {
+        int axis = face / 2;
+        float sign = (face & 1) ? -1.0f : 1.0f;
+
+        int dominant = 0;
+        for(int k = 1; k < 3; ++k) {
+            if(fabsf(tform[axis][k]) > fabsf(tform[axis][dominant])) dominant = k;
+        }
+        directions[face] = dominant * 2 + (sign * tform[axis][dominant] < 0.0f);
+    }
+}
+
+// Which variant of the bale the cell (x, y) gets, once it's been placed with
+// tform.
+static size_t
+hay_cell_variant(struct map *map, int32_t x, int32_t y, mat4 tform) {
+    // Out of the map counts as empty here (map_get says hay, to keep the
+    // player in), so the outside of the level stays whole.
+    static const int32_t dir_dx[4] = { 1, -1, 0, 0 };
+    static const int32_t dir_dy[4] = { 0, 0, 1, -1 };
+
+    int directions[6];
+    hay_face_directions(tform, directions);
+
+    int toward_camera = 0;
+    uint8_t hidden = 0;
+    for(int face = 0; face < 6; ++face) {
+        int dir = directions[face];
+        if(dir == 4) toward_camera = face;
+        if(dir >= 4) continue;
+
+        int32_t nx = x + dir_dx[dir];
+        int32_t ny = y + dir_dy[dir];
+        if(nx < 0 || ny < 0 || nx >= map->width || ny >= map->height) continue;
+        if(map_get(map, nx, ny) == CELL_HAY) hidden |= 1 << face;
+    }
+
+    return (size_t)toward_camera * 64 + hidden;
+}
+
+static bool
+bale_triangle_hidden(struct level_mesh *level, size_t tri, int toward_camera, uint8_t hidden) {
+    uint8_t faces = level->bale_faces[tri];
+    if(faces == 0) return false;
+
+    // The face opposite toward_camera is the back one.
+    uint8_t removable = 1 << (toward_camera ^ 1);
+    float depth = level->bale_reach[tri][toward_camera];
+    if(depth <= LEVEL_HIDDEN_DEPTH * level->bale_extent[toward_camera]) removable |= hidden;
+    if(faces & ~removable) return false;
+
+    // A triangle on the edge between two sides can be seen diagonally, past
+    // the corner of both neighbours.
+    uint8_t sides = faces & ~(1 << toward_camera) & ~(1 << (toward_camera ^ 1));
+    return (sides & (sides - 1)) == 0;
+}
+
+static struct level_bale_variant*
+get_bale_variant(struct level_mesh *level, size_t key) {
+    struct level_bale_variant *variant = &level->variants[key];
+    if(variant->built) return variant;
+
+    struct static_mesh *bale = level->bale;
+    size_t vert_data_count = bale->vertices_count / STATIC_MESH_4BYTES_COUNT;
+    size_t tri_data_count = bale->triangles_count / 3;
+    int toward_camera = (int)(key / 64);
+    uint8_t hidden = (uint8_t)(key % 64);
+
+    // Bale vertex -> variant vertex, UINT32_MAX until it's used.
+    uint32_t *remap = eng_zalloc(sizeof(uint32_t) * vert_data_count);
+    memset(remap, 0xff, sizeof(uint32_t) * vert_data_count);
+
+    uint32_t *vertices = eng_zalloc(sizeof(uint32_t) * vert_data_count);
+    uint16_t *indices = eng_zalloc(sizeof(uint16_t) * bale->triangles_count);
+    size_t vertex_count = 0;
+    size_t index_count = 0;
+
+    for(size_t i = 0; i < tri_data_count; ++i) {
+        if(bale_triangle_hidden(level, i, toward_camera, hidden)) continue;
+
+        for(size_t k = 0; k < 3; ++k) {
+            uint32_t v = bale->triangles[i * 3 + k];
+            if(remap[v] == UINT32_MAX) {
+                remap[v] = vertex_count;
+                vertices[vertex_count++] = v;
+            }
+            indices[index_count++] = remap[v];
+        }
+    }
+
+    eng_free(remap, sizeof(uint32_t) * vert_data_count);
+
+    // Keep only what's used; the variants stay around for the whole game.
+    variant->vertices = eng_zalloc(sizeof(uint32_t) * (vertex_count + 1));
+    memcpy(variant->vertices, vertices, sizeof(uint32_t) * vertex_count);
+    variant->indices = eng_zalloc(sizeof(uint16_t) * (index_count + 1));
+    memcpy(variant->indices, indices, sizeof(uint16_t) * index_count);
+    variant->vertex_count = vertex_count;
+    variant->index_count = index_count;
+    variant->built = true;
+
+    eng_free(vertices, sizeof(uint32_t) * vert_data_count);
+    eng_free(indices, sizeof(uint16_t) * bale->triangles_count);
+
+    return variant;
+}
+
+void
+level_mesh_init(struct level_mesh *level, struct static_mesh *bale) {
+    level->bale = bale;
+
+    size_t vert_data_count = bale->vertices_count / STATIC_MESH_4BYTES_COUNT;
+    size_t tri_data_count = bale->triangles_count / 3;
+
+    for(int face = 0; face < 6; ++face) level->bale_extent[face] = 0.0f;
+    for(size_t i = 0; i < vert_data_count; ++i) {
+        float *v = &bale->vertices[i * STATIC_MESH_4BYTES_COUNT];
+        for(int face = 0; face < 6; ++face) {
+            float d = (face & 1) ? -v[face / 2] : v[face / 2];
+            if(d > level->bale_extent[face]) level->bale_extent[face] = d;
+        }
+    }
+
+    level->bale_faces = eng_zalloc(sizeof(*level->bale_faces) * tri_data_count);
+    level->bale_reach = eng_zalloc(sizeof(*level->bale_reach) * tri_data_count);
+
+    for(size_t i = 0; i < tri_data_count; ++i) {
+        uint8_t faces = LEVEL_ALL_FACES;
+        for(int face = 0; face < 6; ++face) level->bale_reach[i][face] = -FLT_MAX;
+
+        for(size_t k = 0; k < 3; ++k) {
+            float *v = &bale->vertices[bale->triangles[i * 3 + k] * STATIC_MESH_4BYTES_COUNT];
+            for(int face = 0; face < 6; ++face) {
+                float d = (face & 1) ? -v[face / 2] : v[face / 2];
+                if(d < LEVEL_FACE_DEPTH * level->bale_extent[face]) faces &= ~(1 << face);
+                if(d > level->bale_reach[i][face]) level->bale_reach[i][face] = d;
+            }
+        }
+
+        level->bale_faces[i] = faces;
+    }
+}
+
+// Appends a copy of the variant of the bale, placed with cube_tform, to the
+// batch being built in verts/tris, and grows the bounds to fit it.
+static void
+copy_hay_mesh(struct static_mesh *bale, struct level_bale_variant *variant, float *verts, uint16_t *tris,
+        GLuint *vertptr, GLuint *triptr, mat4 cube_tform, vec3 bounds_min, vec3 bounds_max) {
+    // The actual vertex indices into the array, as far as the GPU is concerned,
+    // are real vertex indices, i.e. the sub_data pointer divided by 6.
+    uint16_t tri_base = *vertptr / LEVEL_MESH_ATTRIBS;
+
+    mat4 normal_mat;
+    glm_mat4_copy(cube_tform, normal_mat);
+    glm_mat4_transpose(normal_mat);
+    glm_mat4_inv(normal_mat, normal_mat);
+
+    for(size_t i = 0; i < variant->vertex_count; ++i) {
+        size_t i6 = *vertptr;
+        size_t i8 = variant->vertices[i] * STATIC_MESH_4BYTES_COUNT;
+
+        vec4 pos = {
+            bale->vertices[i8 + 0],
+            bale->vertices[i8 + 1],
+            bale->vertices[i8 + 2],
+            1.0
+        };
+
+        vec4 norm = {
+            bale->vertices[i8 + 3],
+            bale->vertices[i8 + 4],
+            bale->vertices[i8 + 5],
+            0.0
+        };
+
+        glm_mat4_mulv(cube_tform, pos, pos);
+        glm_mat4_mulv(normal_mat, norm, norm);
+
+        glm_vec3_minv(bounds_min, pos, bounds_min);
+        glm_vec3_maxv(bounds_max, pos, bounds_max);
+
+        verts[i6 + 0] = pos[0];
+        verts[i6 + 1] = pos[1];
+        verts[i6 + 2] = pos[2];
+        verts[i6 + 3] = norm[0];
+        verts[i6 + 4] = norm[1];
+        verts[i6 + 5] = norm[2];
+
+        verts[i6 + 6] = bale->vertices[i8 + 6];
+        verts[i6 + 7] = bale->vertices[i8 + 7];
+
+        *vertptr += LEVEL_MESH_ATTRIBS;
+    }
+
+    for(size_t i = 0; i < variant->index_count; ++i) {
+        tris[*triptr] = variant->indices[i] + tri_base;
+        *triptr += 1;
+    }
+}
+
+// Puts data in buffer, which is currently capacity bytes big: in place if it
+// fits, otherwise by reallocating it.
+static void
+upload_buffer(GLenum target, GLuint buffer, size_t *capacity, const void *data, size_t bytes) {
+    REPORT(glBindBuffer(target, buffer));
+    if(bytes <= *capacity) {
+        REPORT(glBufferSubData(target, 0, bytes, data));
+    }
+    else {
+        REPORT(glBufferData(target, bytes, data, GL_STATIC_DRAW));
+        *capacity = bytes;
+    }
+}
+
+static void
+upload_batch(struct level_batch *batch, float *verts, GLuint vert_floats, uint16_t *tris, GLuint index_count) {
+    batch->index_count = index_count;
+
+    if(!batch->array_buf) {
+        REPORT(glGenBuffers(1, &batch->array_buf));
+        REPORT(glGenBuffers(1, &batch->element_buf));
+    }
+
+    upload_buffer(GL_ARRAY_BUFFER, batch->array_buf, &batch->array_bytes, verts, sizeof(float) * vert_floats);
+    upload_buffer(GL_ELEMENT_ARRAY_BUFFER, batch->element_buf, &batch->element_bytes, tris, sizeof(uint16_t) * index_count);
+}
+
+// The chunk's next unused batch, keeping its buffers if an earlier build
+// made some.
+static struct level_batch*
+next_batch(struct level_chunk *chunk) {
+    if(chunk->batch_count == chunk->batch_slots) {
+        size_t slots = chunk->batch_slots ? chunk->batch_slots * 2 : 1;
+        struct level_batch *batches = eng_zalloc(sizeof(*batches) * slots);
+        if(chunk->batches) {
+            memcpy(batches, chunk->batches, sizeof(*batches) * chunk->batch_slots);
+            eng_free(chunk->batches, sizeof(*batches) * chunk->batch_slots);
+        }
+        chunk->batches = batches;
+        chunk->batch_slots = slots;
+    }
+
+    return &chunk->batches[chunk->batch_count++];
+}
+
+// (Re)meshes the cells of chunk (cx, cy) and uploads them.
+static void
+build_chunk(struct level_mesh *level, int32_t cx, int32_t cy) {
+    struct map *map = level->map;
+    float *verts = level->scratch_verts;
+    uint16_t *tris = level->scratch_tris;
+    size_t max_vertices = level->bales_per_batch * (level->bale->vertices_count / STATIC_MESH_4BYTES_COUNT);
+    size_t max_indices = level->bales_per_batch * level->bale->triangles_count;
+
+    struct level_chunk *chunk = &level->chunks[cy * level->chunks_x + cx];
+
+    int32_t x0 = cx * LEVEL_CHUNK_CELLS;
+    int32_t y0 = cy * LEVEL_CHUNK_CELLS;
+    int32_t x1 = x0 + LEVEL_CHUNK_CELLS;
+    int32_t y1 = y0 + LEVEL_CHUNK_CELLS;
+    if(x1 > map->width) x1 = map->width;
+    if(y1 > map->height) y1 = map->height;
+
+    glm_vec3_fill(chunk->bounds_min, FLT_MAX);
+    glm_vec3_fill(chunk->bounds_max, -FLT_MAX);
+    chunk->index_count = 0;
+    chunk->batch_count = 0;
+    chunk->dirty = false;
+
+    // Bales lose different amounts of their faces, so how many fit in a
+    // batch isn't known up front.
+    GLuint vertptr = 0;
+    GLuint triptr = 0;
+
+    for(int32_t x = x0; x < x1; ++x) {
+        for(int32_t y = y0; y < y1; ++y) {
+            if(map_get(map, x, y) != CELL_HAY) continue;
+
+            mat4 tform;
+            hay_cell_tform(x, y, tform);
+            struct level_bale_variant *variant = get_bale_variant(level, hay_cell_variant(map, x, y, tform));
+
+            // Flush first if this bale wouldn't fit.
+            if(vertptr / LEVEL_MESH_ATTRIBS + variant->vertex_count > max_vertices
+                    || triptr + variant->index_count > max_indices) {
+                upload_batch(next_batch(chunk), verts, vertptr, tris, triptr);
+                chunk->index_count += triptr;
+
+                vertptr = 0;
+                triptr = 0;
+            }
+
+            copy_hay_mesh(level->bale, variant, verts, tris, &vertptr, &triptr, tform,
+                chunk->bounds_min, chunk->bounds_max);
+        }
+    }
+
+    if(triptr > 0) {
+        upload_batch(next_batch(chunk), verts, vertptr, tris, triptr);
+        chunk->index_count += triptr;
+    }
+}
+
+static void
+level_mesh_on_map_set(struct map *map, int32_t x, int32_t y, void *user) {
+    level_mesh_mark_dirty(user, x, y);
+}
+
+// Frees what level_mesh_build made, but not what level_mesh_init did, so the
+// level can be built again.
+static void
+level_mesh_free_build(struct level_mesh *level) {
+    for(int32_t i = 0; i < level->chunks_x * level->chunks_y; ++i) {
+        struct level_chunk *chunk = &level->chunks[i];
+
+        // Including the unused slots, which may still have buffers.
+        for(size_t b = 0; b < chunk->batch_slots; ++b) {
+            struct level_batch *batch = &chunk->batches[b];
+            if(batch->array_buf) {
+                REPORT(glDeleteBuffers(1, &batch->array_buf));
+            }
+            if(batch->element_buf) {
+                REPORT(glDeleteBuffers(1, &batch->element_buf));
+            }
+        }
+        eng_free(chunk->batches, sizeof(*chunk->batches) * chunk->batch_slots);
+    }
+    eng_free(level->chunks, sizeof(*level->chunks) * level->chunks_x * level->chunks_y);
+    level->chunks = NULL;
+    level->chunks_x = 0;
+    level->chunks_y = 0;
+
+    if(level->scratch_verts) {
+        size_t vert_data_count = level->bale->vertices_count / STATIC_MESH_4BYTES_COUNT;
+        eng_free(level->scratch_verts, sizeof(float) * LEVEL_MESH_ATTRIBS * level->bales_per_batch * vert_data_count);
+        eng_free(level->scratch_tris, sizeof(uint16_t) * level->bales_per_batch * level->bale->triangles_count);
+    }
+    level->scratch_verts = NULL;
+    level->scratch_tris = NULL;
+    level->bales_per_batch = 0;
+
+    if(level->map && level->map->on_set_user == level) {
+        level->map->on_set = NULL;
+        level->map->on_set_user = NULL;
+    }
+    level->map = NULL;
+}
+
+void
+level_mesh_free(struct level_mesh *level) {
+    level_mesh_free_build(level);
+
+    for(size_t i = 0; i < LEVEL_BALE_VARIANTS; ++i) {
+        struct level_bale_variant *variant = &level->variants[i];
+        if(!variant->built) continue;
+
+        eng_free(variant->vertices, sizeof(uint32_t) * (variant->vertex_count + 1));
+        eng_free(variant->indices, sizeof(uint16_t) * (variant->index_count + 1));
+        *variant = (struct level_bale_variant){0};
+    }
+
+    if(level->bale) {
+        size_t tri_data_count = level->bale->triangles_count / 3;
+        eng_free(level->bale_faces, sizeof(*level->bale_faces) * tri_data_count);
+        eng_free(level->bale_reach, sizeof(*level->bale_reach) * tri_data_count);
+    }
+    level->bale_faces = NULL;
+    level->bale_reach = NULL;
+    level->bale = NULL;
+}
+
+void
+level_mesh_build(struct level_mesh *level, struct map *map) {
+    struct static_mesh *bale = level->bale;
+
+    // Building again (e.g. reloading the level) starts from scratch.
+    if(level->chunks) level_mesh_free_build(level);
+    level->map = map;
+
+    size_t vert_data_count = bale->vertices_count / STATIC_MESH_4BYTES_COUNT;
+    size_t tri_data_count = bale->triangles_count / 3;
+
+    // Each batch gets as many bales as 16-bit indices can reach (36 whole ones
+    // of the current mesh, more once hidden faces are gone).
+    size_t bales_per_batch = OURGL_MAX_SHORT_VERTICES / vert_data_count;
+    if(bales_per_batch == 0) {
+        SDL_Log("level_mesh_build: the hay mesh has too many vertices (%zu)", vert_data_count);
+        return;
+    }
+
+    level->chunks_x = (map->width + LEVEL_CHUNK_CELLS - 1) / LEVEL_CHUNK_CELLS;
+    level->chunks_y = (map->height + LEVEL_CHUNK_CELLS - 1) / LEVEL_CHUNK_CELLS;
+    level->chunks = eng_zalloc(sizeof(*level->chunks) * level->chunks_x * level->chunks_y);
+
+    // Fow now, just clone the vertex data for every vertex. We could try to
+    // find a way to only have one copy of normals.
+    level->bales_per_batch = bales_per_batch;
+    level->scratch_verts = eng_zalloc(sizeof(float) * LEVEL_MESH_ATTRIBS * bales_per_batch * vert_data_count);
+    level->scratch_tris = eng_zalloc(sizeof(uint16_t) * 3 * bales_per_batch * tri_data_count);
+
+    for(int32_t cy = 0; cy < level->chunks_y; ++cy) {
+        for(int32_t cx = 0; cx < level->chunks_x; ++cx) {
+            build_chunk(level, cx, cy);
+        }
+    }
+
+    map->on_set = level_mesh_on_map_set;
+    map->on_set_user = level;
+}
+
+void
+level_mesh_mark_dirty(struct level_mesh *level, int32_t x, int32_t y) {
+    static const int32_t dx[5] = { 0, 1, -1, 0, 0 };
+    static const int32_t dy[5] = { 0, 0, 0, 1, -1 };
+
+    for(int i = 0; i < 5; ++i) {
+        int32_t nx = x + dx[i];
+        int32_t ny = y + dy[i];
+        if(nx < 0 || ny < 0 || nx >= level->map->width || ny >= level->map->height) continue;
+
+        level->chunks[(ny / LEVEL_CHUNK_CELLS) * level->chunks_x + nx / LEVEL_CHUNK_CELLS].dirty = true;
+    }
+}
+
+size_t
+level_mesh_update(struct level_mesh *level) {
+    size_t rebuilt = 0;
+
+    for(int32_t cy = 0; cy < level->chunks_y; ++cy) {
+        for(int32_t cx = 0; cx < level->chunks_x; ++cx) {
+            if(!level->chunks[cy * level->chunks_x + cx].dirty) continue;
+
+            build_chunk(level, cx, cy);
+            rebuilt += 1;
+        }
+    }
+
+    return rebuilt;
+}
+
+struct level_mesh_size
+level_mesh_measure(struct level_mesh *level, struct map *map, bool remove_hidden) {
+    struct level_mesh_size size = {0};
+
+    size_t vert_data_count = level->bale->vertices_count / STATIC_MESH_4BYTES_COUNT;
+    size_t tri_data_count = level->bale->triangles_count / 3;
+
+    for(int32_t x = 0; x < map->width; ++x) {
+        for(int32_t y = 0; y < map->height; ++y) {
+            if(map_get(map, x, y) != CELL_HAY) continue;
+
+            if(!remove_hidden) {
+                size.triangles += tri_data_count;
+                size.vertices += vert_data_count;
+                continue;
+            }
+
+            mat4 tform;
+            hay_cell_tform(x, y, tform);
+            struct level_bale_variant *variant = get_bale_variant(level, hay_cell_variant(map, x, y, tform));
+            size.triangles += variant->index_count / 3;
+            size.vertices += variant->vertex_count;
+        }
+    }
+
+    size.vertex_bytes = size.vertices * LEVEL_MESH_ATTRIBS * sizeof(float);
+    return size;
+}
+
+void
+level_mesh_draw(struct level_mesh *level, mat4 vp, struct level_draw_stats *stats) {
+    struct level_draw_stats counted = {0};
+
+    vec4 planes[6];
+    glm_frustum_planes(vp, planes);
+
+    for(int32_t i = 0; i < level->chunks_x * level->chunks_y; ++i) {
+        struct level_chunk *chunk = &level->chunks[i];
+        if(chunk->batch_count == 0) continue;
+
+        counted.chunks_total += 1;
+
+        vec3 box[2];
+        glm_vec3_copy(chunk->bounds_min, box[0]);
+        glm_vec3_copy(chunk->bounds_max, box[1]);
+        if(!glm_aabb_frustum(box, planes)) continue;
+
+        counted.chunks_drawn += 1;
+        counted.triangles += chunk->index_count / 3;
+
+        // Vertex attributes capture the buffer bound when they're set, so
+        // each batch has to point them at its own.
+        for(size_t b = 0; b < chunk->batch_count; ++b) {
+            struct level_batch *batch = &chunk->batches[b];
+
+            REPORT(glBindBuffer(GL_ARRAY_BUFFER, batch->array_buf));
+            REPORT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch->element_buf));
+
+            REPORT(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, LEVEL_MESH_ATTRIBS * sizeof(float), (void*)0));
+            REPORT(glEnableVertexAttribArray(0));
+
+            REPORT(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, LEVEL_MESH_ATTRIBS * sizeof(float), (void*)(sizeof(float) * 3)));
+            REPORT(glEnableVertexAttribArray(1));
+
+            REPORT(glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, LEVEL_MESH_ATTRIBS * sizeof(float), (void*)(sizeof(float) * 6)));
+            REPORT(glEnableVertexAttribArray(4));
+
+            REPORT(glDrawElements(GL_TRIANGLES, batch->index_count, GL_UNSIGNED_SHORT, 0));
+        }
+    }
+
+    if(stats) *stats = counted;
+}
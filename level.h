@@ -0,0 +1,164 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include "map.h"
+
+#include "engine/our_gl.h"
+#include "engine/static_mesh.h"
+
+#include <cglm/cglm.h>
+
+// Floats per level vertex: position, normal, uv.
+#define LEVEL_MESH_ATTRIBS 8
+
+// The level is meshed (and culled) in squares of this many cells a side.
+#define LEVEL_CHUNK_CELLS 16
+
+// Cells are this far apart in the world.
+#define LEVEL_CELL_SIZE 2.0f
+
+// A run of whole bales, few enough that 16-bit indices can address all of
+// their vertices.
+struct level_batch {
+    GLuint array_buf;
+    GLuint element_buf;
+
+    // How big the buffers are, which can be more than what's in use after a
+    // rebuild.
+    size_t array_bytes;
+    size_t element_bytes;
+
+    size_t index_count;
+};
+
+// The bales in one LEVEL_CHUNK_CELLS square of the map.
+struct level_chunk {
+    // World-space box around every vertex in the chunk.
+    vec3 bounds_min;
+    vec3 bounds_max;
+
+    // The first batch_count are in use. The rest kept their buffers from an
+    // earlier build, for the next rebuild to fill.
+    struct level_batch *batches;
+    size_t batch_count;
+    size_t batch_slots;
+
+    size_t index_count;
+
+    // Set when a cell in or next to the chunk changed; level_mesh_update
+    // rebuilds it.
+    bool dirty;
+};
+
+// The bale with the faces that can't be seen in some placement left out (see
+// level.c). Built the first time a cell needs it.
+struct level_bale_variant {
+    bool built;
+
+    // The bale vertex each of the variant's vertices is a copy of.
+    uint32_t *vertices;
+    size_t vertex_count;
+
+    // Into vertices.
+    uint16_t *indices;
+    size_t index_count;
+};
+
+// One per bale direction that can end up facing the camera, times every set
+// of directions that can be hidden.
+#define LEVEL_BALE_VARIANTS (6 * 64)
+
+struct level_mesh {
+    // What every hay cell is drawn with; the level keeps a transformed copy of
+    // it per cell.
+    struct static_mesh *bale;
+
+    // For each triangle of the bale: the faces (+x, -x, +y, -y, +z, -z, one
+    // bit each) it is part of, and how far it reaches in each of those
+    // directions.
+    uint8_t *bale_faces;
+    float (*bale_reach)[6];
+
+    // How far the bale reaches in each direction.
+    float bale_extent[6];
+
+    struct level_bale_variant variants[LEVEL_BALE_VARIANTS];
+
+    // What level_mesh_build meshed, for rebuilding chunks later.
+    struct map *map;
+
+    struct level_chunk *chunks;
+    int32_t chunks_x;
+    int32_t chunks_y;
+
+    // Batch-sized space to build chunks in, kept for rebuilds.
+    float *scratch_verts;
+    uint16_t *scratch_tris;
+    size_t bales_per_batch;
+};
+
+// How big level_mesh_measure found a level would be.
+struct level_mesh_size {
+    size_t triangles;
+    size_t vertices;
+
+    // Of the vertex buffers, at LEVEL_MESH_ATTRIBS floats a vertex.
+    size_t vertex_bytes;
+};
+
+// What the last level_mesh_draw submitted.
+struct level_draw_stats {
+    size_t chunks_drawn;
+    size_t chunks_total;
+    size_t triangles;
+};
+
+/**
+ * Works out which faces of the bale mesh can be left out where bales touch.
+ * bale has to stay around. Doesn't need a GL context.
+ */
+void level_mesh_init(struct level_mesh *level, struct static_mesh *bale);
+
+/**
+ * Meshes every hay cell of map with the bale mesh, chunk by chunk, and
+ * uploads the chunks. Also hooks map_set on map, so that changing a cell
+ * marks the chunks around it for level_mesh_update.
+ */
+void level_mesh_build(struct level_mesh *level, struct map *map);
+
+/**
+ * Marks the chunks that cell (x, y) is part of or borders as needing a
+ * rebuild. Hidden faces depend on the neighbours, so changing a cell can
+ * change the cells next to it too, which may be in another chunk.
+ */
+void level_mesh_mark_dirty(struct level_mesh *level, int32_t x, int32_t y);
+
+/**
+ * Rebuilds the chunks marked dirty since the last call, reusing their
+ * buffers (with glBufferSubData) when the new mesh fits. Returns how many
+ * chunks were rebuilt.
+ */
+size_t level_mesh_update(struct level_mesh *level);
+
+/**
+ * Works out how many triangles and vertices level_mesh_build would make for
+ * map, without making them. With remove_hidden false, every bale is counted
+ * whole, which is what the level used to be. Doesn't need a GL context.
+ */
+struct level_mesh_size level_mesh_measure(struct level_mesh *level, struct map *map, bool remove_hidden);
+
+/**
+ * Frees everything level_mesh_init and level_mesh_build made, including the
+ * GL buffers, and unhooks the map. Needs a GL context if the level was built.
+ * Call level_mesh_init again to reuse level.
+ */
+void level_mesh_free(struct level_mesh *level);
+
+/**
+ * Draws the chunks whose bounds are in the view frustum of vp (projection *
+ * view). The shader, its uniforms and the texture are up to the caller.
+ * stats may be NULL.
+ */
+void level_mesh_draw(struct level_mesh *level, mat4 vp, struct level_draw_stats *stats);
+
+#endif
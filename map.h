@@ -13,6 +13,11 @@ struct map {
     int32_t player_y;
 
     uint8_t *data;
+
+    // Called by map_set when a cell actually changes, e.g. so the level mesh
+    // can be rebuilt around it. May be NULL.
+    void (*on_set)(struct map *map, int32_t x, int32_t y, void *user);
+    void *on_set_user;
 };
 
 struct phys_obj {
@@ -21,9 +21,12 @@ map_set(struct map *map, int32_t x, int32_t y, uint8_t value) {
     if(x < 0 || y < 0) return;
     if(x >= map->width || y >= map->height) return;
 
-    y = map->height - y - 1;
+    int32_t row = map->height - y - 1;
+
+    if(map->data[row * map->width + x] == value) return;
+    map->data[row * map->width + x] = value;
 
-    map->data[y * map->width + x] = value;
+    if(map->on_set) map->on_set(map, x, y, map->on_set_user);
 }
 
 // uint8_t map0_data[] = {
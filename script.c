@@ -1,7 +1,9 @@
 #include "engine/skeletal_mesh.h"
+#include "engine/static_mesh.h"
 #include "engine/shader.h"
 #include "engine/our_gl.h"
 #include "engine/model.h"
+#include "engine/baked_model.h"
 #include "engine/alloc.h"
 
 #include "engine/serialize/serialize_skm.h"
@@ -9,6 +11,7 @@
 #include "shader.h"
 
 #include "map.h"
+#include "level.h"
 #include "actions.h"
 
 #include <cglm/cglm.h>
@@ -30,9 +33,20 @@ struct skm_armature_anim_playback player_jump_playback = {0};
 struct skm_armature_anim player_jump_down_anim = {0};
 struct skm_armature_anim_playback player_jump_down_playback = {0};
 
-struct skeletal_mesh hay_mesh = {0};
+// The blend of the playbacks above that actually gets shown.
+struct skm_pose player_pose = {0};
+struct skm_instance player_instance = {0};
 
-struct skeletal_mesh carrot_mesh = {0};
+// SKM_SKIN_DUAL_QUAT skins the horse with dual quaternions instead.
+enum skm_skinning player_skinning = SKM_SKIN_LINEAR;
+
+// Holds the skinning palettes of every animated character.
+#define SKIN_ATLAS_ROWS 1024
+struct skm_palette_atlas skin_atlas = {0};
+
+struct static_mesh hay_mesh = {0};
+
+struct static_mesh carrot_mesh = {0};
 
 Mix_Chunk *sound_chomp;
 Mix_Chunk *sound_boing;
@@ -136,10 +150,11 @@ struct {
     mat4 model_matrix;
 } player;
 
-struct {
+struct static_shader {
     GLuint v;
     GLuint p;
     GLuint m;
+    GLuint pos_scale;
 
     GLuint base_color;
     GLuint metallic;
@@ -148,126 +163,26 @@ struct {
     GLuint albedo;
 
     GLuint self;
-} static_pbr;
-
-struct {
-    GLuint array_buf;
-    GLuint element_buf;
-
-    size_t triangle_count;
-
-    GLuint shader;
-} level_mesh = {0};
-
-void
-init_level_gl() {
-    REPORT(glGenBuffers(1, &level_mesh.array_buf));
-    REPORT(glGenBuffers(1, &level_mesh.element_buf));
-}
-
-// used to make the hay look slightly more interesting.
-float
-nudge() {
-    // PROBLEM: Our mesh import apparently splits the vertices.
-    // If we can fix this, then we can do this.
-
-    // this is very bad, but it's ok.
-    float x = (float)rand() / (float)RAND_MAX;
-
-    // up to 5 thousandths in any direction.
-    return (x - 0.5) / 1000.0;
-}
+};
 
-float
-rand_angle() {
-    int x = rand() % 4;
-    return x * 6.28 * 0.25;
-}
+struct static_shader static_pbr;
 
-#define LEVEL_MESH_ATTRIBS 8
+// Same uniforms except u_m; each copy is placed by its a_instance instead.
+// Only compiled if carrot_instancing.
+struct static_shader static_inst_pbr;
 
-void
-copy_hay_mesh(float *verts, GLuint *tris, GLuint *vertptr, GLuint *triptr, size_t vert_data_count,
-        size_t tri_data_count, int x, int y) {
-    
-    // The actual vertex indices into the array, as far as the GPU is concerned,
-    // are real vertex indices, i.e. the sub_data pointer divided by 6.
-    GLuint tri_base = *vertptr / LEVEL_MESH_ATTRIBS;
-
-    float off_x = x * 2 + nudge();
-    float off_y = y * 2 + nudge();
-    float off_z = nudge();
-
-    // Unless we nudge all the vertices that are at thes ame location (but that
-    // have different normals?) by the same amount, we can't do the nugding. but
-    // we can nudge entire cubes.
-
-    mat4 cube_tform;
-    glm_rotate_make(cube_tform, rand_angle(), (vec3){ 0, 0, 1 });
-    glm_rotated(cube_tform, rand_angle() + nudge() * 250, (vec3){ 0, 1, 0 });
-    glm_translated(cube_tform, (vec3){ off_x, off_y, off_z });
-
-    mat4 normal_mat;
-    glm_mat4_copy(cube_tform, normal_mat);
-    glm_mat4_transpose(normal_mat);
-    glm_mat4_inv(normal_mat, normal_mat);
-
-    for(size_t i = 0; i < vert_data_count; ++i) {
-        size_t i6 = *vertptr;
-        size_t i14 = i * SKEL_MESH_4BYTES_COUNT;
-
-        vec4 pos = {
-            hay_mesh.vertices[i14 + 0],
-            hay_mesh.vertices[i14 + 1],
-            hay_mesh.vertices[i14 + 2],
-            1.0
-        };
-
-        vec4 norm = {
-            hay_mesh.vertices[i14 + 3],
-            hay_mesh.vertices[i14 + 4],
-            hay_mesh.vertices[i14 + 5],
-            0.0
-        };
-
-        glm_mat4_mulv(cube_tform, pos, pos);
-        glm_mat4_mulv(normal_mat, norm, norm);
-
-        verts[i6 + 0] = pos[0];
-        verts[i6 + 1] = pos[1];
-        verts[i6 + 2] = pos[2];
-        verts[i6 + 3] = norm[0];
-        verts[i6 + 4] = norm[1];
-        verts[i6 + 5] = norm[2];
-
-        verts[i6 + 6] = hay_mesh.vertices[i14 + 14];
-        verts[i6 + 7] = hay_mesh.vertices[i14 + 15];
-
-        *vertptr += LEVEL_MESH_ATTRIBS;
-    }
+// Whether the carrots can be drawn with one instanced call. If not, they get
+// a draw call each with static_pbr.
+bool carrot_instancing = false;
+GLuint carrot_instance_buf = 0;
+struct stm_instance carrot_instances[256];
 
-    for(size_t i = 0; i < tri_data_count; ++i) {
-        size_t j3 = *triptr;
-        size_t i3 = i * 3;
-        tris[j3 + 0] = hay_mesh.triangles[i3 + 0] + tri_base;
-        tris[j3 + 1] = hay_mesh.triangles[i3 + 1] + tri_base;
-        tris[j3 + 2] = hay_mesh.triangles[i3 + 2] + tri_base;
-
-        *triptr += 3;
-    }
-}
+struct level_mesh level_mesh = {0};
 
 void
 gen_level_mesh(struct map *map) {
-    // First pass: count mesh.
-    size_t hay_count = 0;
-
     for(int x = 0; x < map->width; ++x) {
         for(int y = 0; y < map->height; ++y) {
-            if(map_get(map, x, y) == CELL_HAY) {
-                hay_count += 1;
-            }
-
             if(map_get(map, x, y) == CELL_CARROT) {
                 // Instantiate a carrot.
                 carrots[carrot_count++] = (struct carrot){
@@ -283,37 +198,8 @@ gen_level_mesh(struct map *map) {
         }
     }
 
-    size_t vert_data_count = hay_mesh.vertices_count / SKEL_MESH_4BYTES_COUNT;
-    size_t tri_data_count = hay_mesh.triangles_count / 3;
-
-    // Fow now, just clone the vertex data for every vertex. We could try to 
-    // find a way to only have one copy of normals.
-    size_t verts_size = sizeof(float) * LEVEL_MESH_ATTRIBS * hay_count * vert_data_count;
-    float *verts = eng_zalloc(verts_size);
-    size_t tris_size = sizeof(GLuint) * 3 * hay_count * tri_data_count;
-    GLuint *tris = eng_zalloc(tris_size);
-
-    GLuint vertptr = 0;
-    GLuint triptr = 0;
-
-    level_mesh.triangle_count = hay_count * tri_data_count * 3;
-
-    for(int x = 0; x < map->width; ++x) {
-        for(int y = 0; y < map->height; ++y) {
-            if(map_get(map, x, y) == CELL_HAY) {
-                copy_hay_mesh(verts, tris, &vertptr, &triptr, vert_data_count,
-                    tri_data_count, x, y);
-            }
-        }
-    }
-
-    REPORT(glBindBuffer(GL_ARRAY_BUFFER, level_mesh.array_buf));
-    REPORT(glBufferData(GL_ARRAY_BUFFER, verts_size, verts, GL_STATIC_DRAW));
-    REPORT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, level_mesh.element_buf));
-    REPORT(glBufferData(GL_ELEMENT_ARRAY_BUFFER, tris_size, tris, GL_STATIC_DRAW));
-
-    eng_free(verts, verts_size);
-    eng_free(tris, tris_size);
+    level_mesh_init(&level_mesh, &hay_mesh);
+    level_mesh_build(&level_mesh, map);
 }
 
 void
@@ -334,6 +220,12 @@ pass_vp() {
     REPORT(glUseProgram(static_pbr.self));
     REPORT(glUniformMatrix4fv(static_pbr.p, 1, false, p_matrix[0]));
     REPORT(glUniformMatrix4fv(static_pbr.v, 1, false, v_matrix[0]));
+
+    if(carrot_instancing) {
+        REPORT(glUseProgram(static_inst_pbr.self));
+        REPORT(glUniformMatrix4fv(static_inst_pbr.p, 1, false, p_matrix[0]));
+        REPORT(glUniformMatrix4fv(static_inst_pbr.v, 1, false, v_matrix[0]));
+    }
 }
 
 void
@@ -349,19 +241,35 @@ void init_player();
 static Mix_Music *game_music = NULL;
 
 const float anim_start_seek = 60.0 / 24.0;
+const float anim_loop_length = 60.0 / 24.0;
+
+void
+init_static_shader(struct static_shader *shader, const char *vert_src) {
+    shader->self = ourgl_compile_shader(vert_src, skel_frag_src);
+    REPORT(shader->p = glGetUniformLocation(shader->self, "u_p"));
+    REPORT(shader->v = glGetUniformLocation(shader->self, "u_v"));
+    REPORT(shader->m = glGetUniformLocation(shader->self, "u_m"));
+    REPORT(shader->pos_scale = glGetUniformLocation(shader->self, "u_pos_scale"));
+    REPORT(shader->metallic = glGetUniformLocation(shader->self, "metallic"));
+    REPORT(shader->perceptual_roughness = glGetUniformLocation(shader->self, "perceptual_roughness"));
+    REPORT(shader->base_color = glGetUniformLocation(shader->self, "base_color"));
+    REPORT(shader->albedo = glGetUniformLocation(shader->self, "u_albedo"));
+}
 
 void
 init() {
-    static_pbr.self = ourgl_compile_shader(static_vert_src, skel_frag_src);
-    REPORT(static_pbr.p = glGetUniformLocation(static_pbr.self, "u_p"));
-    REPORT(static_pbr.v = glGetUniformLocation(static_pbr.self, "u_v"));
-    REPORT(static_pbr.m = glGetUniformLocation(static_pbr.self, "u_m"));
-    REPORT(static_pbr.metallic = glGetUniformLocation(static_pbr.self, "metallic"));
-    REPORT(static_pbr.perceptual_roughness = glGetUniformLocation(static_pbr.self, "perceptual_roughness"));
-    REPORT(static_pbr.base_color = glGetUniformLocation(static_pbr.self, "base_color"));
-    REPORT(static_pbr.albedo = glGetUniformLocation(static_pbr.self, "u_albedo"));
+    init_static_shader(&static_pbr, static_vert_src);
 
-    skel_pbr.self = ourgl_compile_shader(skel_vert_src, skel_frag_src);
+    carrot_instancing = stm_gl_load_instancing();
+    if(carrot_instancing) {
+        init_static_shader(&static_inst_pbr, static_inst_vert_src);
+        REPORT(glGenBuffers(1, &carrot_instance_buf));
+    }
+
+    // Both vertex shaders have the same uniforms, so the rest of the setup
+    // doesn't care which one the player uses.
+    const char *skel_src = (player_skinning == SKM_SKIN_DUAL_QUAT) ? skel_dq_vert_src : skel_vert_src;
+    skel_pbr.self = ourgl_compile_shader(skel_src, skel_frag_src);
 
     REPORT(skel_pbr.p = glGetUniformLocation(skel_pbr.self, "u_p"));
     REPORT(skel_pbr.v = glGetUniformLocation(skel_pbr.self, "u_v"));
@@ -405,9 +313,9 @@ init() {
     };
 
     struct import_data hay_id = {
-        .skm = (struct skeletal_mesh*[]){ &hay_mesh },
-        .num_skm = 1,
-        .got_skm = 0,
+        .stm = (struct static_mesh*[]){ &hay_mesh },
+        .num_stm = 1,
+        .got_stm = 0,
 
         .skm_arm_anim = NULL,
         .num_skm_arm_anim = 0,
@@ -419,9 +327,9 @@ init() {
     };
 
     struct import_data carrot_id = {
-        .skm = (struct skeletal_mesh*[]){ &carrot_mesh },
-        .num_skm = 1,
-        .got_skm = 0,
+        .stm = (struct static_mesh*[]){ &carrot_mesh },
+        .num_stm = 1,
+        .got_stm = 0,
 
         .skm_arm_anim = NULL,
         .num_skm_arm_anim = 0,
@@ -432,9 +340,10 @@ init() {
         .got_texture = 0,
     };
 
-    load_model("blender/horse.glb", &player_id);
-    load_model("blender/hay.glb", &hay_id);
-    load_model("blender/carrot.glb", &carrot_id);
+    // These are baked from the .glb files at build time by tool/bake_model.c.
+    load_baked_model("blender/horse.bake", &player_id);
+    load_baked_model("blender/hay.bake", &hay_id);
+    load_baked_model("blender/carrot.bake", &carrot_id);
 
     player_tex = player_id.texture[0];
     hay_tex = hay_id.texture[0];
@@ -454,21 +363,28 @@ init() {
     skm_arm_playback_init(&player_idle_playback, &player_idle_anim);
     skm_arm_playback_init(&player_jump_playback, &player_jump_anim);
     skm_arm_playback_init(&player_jump_down_playback, &player_jump_down_anim);
+    skm_pose_init(&player_pose, player_mesh.bone_count);
 
     player_mesh.shader = skel_pbr.self;
+    player_mesh.skinning = player_skinning;
     skm_gl_init(&player_mesh);
+    skm_palette_atlas_init(&skin_atlas, SKIN_ATLAS_ROWS, skm_palette_texels(&player_mesh));
+    skm_palette_atlas_gl_init(&skin_atlas);
+
+    skm_instance_init(&player_instance, &player_mesh);
+    skm_palette_atlas_add(&skin_atlas, &player_instance);
 
-    skm_gl_init(&carrot_mesh);
+    carrot_mesh.shader = carrot_instancing ? static_inst_pbr.self : static_pbr.self;
+    stm_gl_init(&carrot_mesh);
 
     REPORT(glUseProgram(skel_pbr.self));
-    REPORT(glUniform1f(skel_pbr.skeleton_count, (float)player_mesh.bone_count));
+    REPORT(glUniform1f(skel_pbr.skeleton_count, (float)skin_atlas.rows));
     REPORT(glUniform1i(skel_pbr.skeleton, 1)); // match GL_TEXTURE1 from skeletal_mesh.c
 
     SDL_Log("init called.");
 
     init_player();
 
-    init_level_gl();
     gen_level_mesh(&map0);
 
     null_texture = generate_null_texture();
@@ -478,6 +394,12 @@ init() {
     skm_arm_playback_seek(&player_idle_playback, anim_start_seek);
     skm_arm_playback_seek(&player_jump_playback, anim_start_seek);
     skm_arm_playback_seek(&player_jump_down_playback, anim_start_seek);
+
+    const float anim_boundary = anim_start_seek + anim_loop_length;
+    skm_arm_playback_set_loop(&player_walk_playback, anim_start_seek, anim_boundary);
+    skm_arm_playback_set_loop(&player_idle_playback, anim_start_seek, anim_boundary);
+    skm_arm_playback_set_loop(&player_jump_playback, anim_start_seek, anim_boundary);
+    skm_arm_playback_set_loop(&player_jump_down_playback, anim_start_seek, anim_boundary);
 }
 
 #include <stdlib.h>
@@ -520,6 +442,9 @@ struct action act_right = {
 struct action act_jump = {
     .code = SDLK_SPACE
 };
+struct action act_stats = {
+    .code = SDLK_F3
+};
 
 float max_walk_vel = 0.8f;
 float max_jump_vel = 0.9f;
@@ -656,114 +581,26 @@ tick_player(double dt) {
     pass_vp();
 }
 
-// void
-// get_single_anim_bone(mat4 out, struct skm_armature_anim_playback *playback, size_t i) {
-//     glm_mat4_copy(playback->state[i].scale_matrix, out);
-//     glm_mat4_mul(playback->state[i].rotation_matrix, out, out);
-//     glm_mat4_mul(playback->state[i].position_matrix, out, out);
-// }
-
-CGLM_INLINE
-void
-my_quat_mat4(versor q, mat4 dest) {
-  double w, x, y, z,
-        xx, yy, zz,
-        xy, yz, xz,
-        wx, wy, wz, norm, s;
-
-  norm = glm_quat_norm(q);
-  //s    = norm > 0.0f ? 2.0f / norm : 0.0f;
-  norm = (norm > 0.0 ? norm : INFINITY);
-
-  x = q[0];
-  y = q[1];
-  z = q[2];
-  w = q[3];
-
-  xx = 2.0 * x * x / norm;   xy = 2.0 * x * y / norm;   wx = 2.0 * w * x / norm;
-  yy = 2.0 * y * y / norm;   yz = 2.0 * y * z / norm;   wy = 2.0 * w * y / norm;
-  zz = 2.0 * z * z / norm;   xz = 2.0 * x * z / norm;   wz = 2.0 * w * z / norm;
-
-  dest[0][0] = 1.0f - yy - zz;
-  dest[1][1] = 1.0f - xx - zz;
-  dest[2][2] = 1.0f - xx - yy;
-
-  dest[0][1] = xy + wz;
-  dest[1][2] = yz + wx;
-  dest[2][0] = xz + wy;
-
-  dest[1][0] = xy - wz;
-  dest[2][1] = yz - wx;
-  dest[0][2] = xz - wy;
-
-  dest[0][3] = 0.0f;
-  dest[1][3] = 0.0f;
-  dest[2][3] = 0.0f;
-  dest[3][0] = 0.0f;
-  dest[3][1] = 0.0f;
-  dest[3][2] = 0.0f;
-  dest[3][3] = 1.0f;
-}
-
-// void
-// my_quat_mat4(versor rot, mat4 matrix) {
-//     float norm = glm_quat_norm(rot);
-//     if(norm < 0.0001) {
-//         glm_mat4_identity(matrix);
-//         return;
-//     }
-//     glm_quat_mat4(rot, matrix);
-// }
-
 void
 apply_playbacks() {
-    struct skeletal_mesh *skm = &player_mesh;
-
-    struct skm_armature_anim_playback *anim1 = anim_prev;
-    struct skm_armature_anim_playback *anim2 = anim_cur;
-    float blend = anim_transition_blend;
-
-    for(size_t i = 0; i < skm->bone_count; ++i) {
-        mat4 translate_matrix;
-        mat4 rotate_matrix;
-        mat4 scale_matrix;
-
-        vec3 pos;
-        versor rot;
-        vec3 scale = GLM_VEC3_ONE_INIT;
-
-        glm_vec3_lerp(anim1->state[i].position, anim2->state[i].position, blend, pos);
-        //glm_vec3_lerp(anim1->state[i].scale, anim2->state[i].scale, blend, scale);
-        glm_quat_normalize(anim1->state[i].rotation);
-        glm_quat_normalize(anim2->state[i].rotation);
-        glm_quat_slerp(anim1->state[i].rotation, anim2->state[i].rotation, blend, rot);
-
-        // apparently this particular normalize() is needed for things not to blow
-        // up. Why? who the hell knows.
-        //
-        // oh. norm is very different from normalize for quaternions.
-        glm_quat_normalize(rot);
-
-        // Hmm. We still have occasional jank. From the one frame I manged to
-        // capture, it didn't look like there was any scaling, but that the
-        // player model was facing entirely the wrong way. Weird..
-
-        glm_translate_make(translate_matrix, pos);
-        my_quat_mat4(rot, rotate_matrix);
-        glm_scale_make(scale_matrix, scale);
-
-        if(fabs(glm_mat4_det(rotate_matrix)) < 0.8) {
-            glm_mat4_identity(rotate_matrix);
-            SDL_Log("bone = %llu", i);
-            SDL_Log("rot0 = %f %f %f %f", anim1->state[i].rotation[0], anim1->state[i].rotation[1], anim1->state[i].rotation[2], anim1->state[i].rotation[3]);
-            SDL_Log("rot1 = %f %f %f %f", anim2->state[i].rotation[0], anim2->state[i].rotation[1], anim2->state[i].rotation[2], anim2->state[i].rotation[3]);
-            SDL_Log("blend = %f %f %f %f", rot[0], rot[1], rot[2], rot[3]);
-        }
+    // Only the playbacks that are actually visible get sampled; the others
+    // just keep time (see tick()).
+    if(anim_transition_blend < 1.0f) skm_arm_playback_sample(anim_prev);
+    skm_arm_playback_sample(anim_cur);
+
+    struct skm_pose_layer layers[] = {
+        { &anim_prev->pose, 1.0f - anim_transition_blend, NULL },
+        { &anim_cur->pose, anim_transition_blend, NULL },
+    };
+    skm_pose_blend(&player_pose, layers, 2);
 
-        glm_mat4_copy(scale_matrix, skm->bone_local_pose[i]);
-        glm_mat4_mul(rotate_matrix, skm->bone_local_pose[i], skm->bone_local_pose[i]);
-        glm_mat4_mul(translate_matrix, skm->bone_local_pose[i], skm->bone_local_pose[i]);
+    // The clips don't key scale properly (see handle_animation), so keep the
+    // bones at rest scale.
+    for(size_t i = 0; i < player_pose.bone_count; ++i) {
+        glm_vec3_one(player_pose.scale[i]);
     }
+
+    skm_pose_compose(&player_pose, player_instance.bone_local_pose);
 }
 
 void
@@ -819,8 +656,17 @@ tick_carrots(double dt) {
     }
 }
 
+// What the animation system evaluated during the last tick. Toggled with F3.
+struct skm_anim_stats anim_stats_last_tick = {0};
+bool show_stats = false;
+
+// What the last frame drew of the level.
+struct level_draw_stats level_stats_last_frame = {0};
+
 void
 tick(double dt) {
+    skm_anim_stats_reset();
+
     tick_player(dt);
     tick_carrots(dt);
 
@@ -832,12 +678,7 @@ tick(double dt) {
     if(jump_message_timer > 0.0) { jump_message_timer -= dt; }
     
     // compute previous frame?
-    skm_compute_matrices(&player_mesh, player.model_matrix);
-
-    const float anim_loop_length = 60.0 / 24.0;
-    
-    const float anim_boundary = anim_start_seek + anim_loop_length;
-
+    skm_compute_matrices(&player_instance, player.model_matrix);
 
     const double anim_ref_vel = 1.157943 / anim_loop_length; 
     double anim_step = 1.0 * dt;
@@ -847,42 +688,48 @@ tick(double dt) {
 
     
 
-    skm_arm_playback_step(&player_walk_playback, anim_step);
-    if(player_walk_playback.time >= anim_boundary) {
-        skm_arm_playback_seek(&player_walk_playback, player_walk_playback.time - anim_loop_length);
-    }
-    skm_arm_playback_step(&player_idle_playback, anim_step);
-    if(player_idle_playback.time >= anim_boundary) {
-        skm_arm_playback_seek(&player_idle_playback, player_idle_playback.time - anim_loop_length);
-    }
-    skm_arm_playback_step(&player_jump_playback, anim_step);
-    if(player_jump_playback.time >= anim_boundary) {
-        skm_arm_playback_seek(&player_jump_playback, player_jump_playback.time - anim_loop_length);
-    }
-    skm_arm_playback_step(&player_jump_down_playback, anim_step);
-    if(player_jump_down_playback.time >= anim_boundary) {
-        skm_arm_playback_seek(&player_jump_down_playback, player_jump_down_playback.time - anim_loop_length);
-    }
+    // Looping is handled by the playbacks themselves (see init()). All of them
+    // keep time so that they are in sync whenever they become active, but
+    // only apply_playbacks() samples them.
+    skm_arm_playback_advance(&player_walk_playback, anim_step);
+    skm_arm_playback_advance(&player_idle_playback, anim_step);
+    skm_arm_playback_advance(&player_jump_playback, anim_step);
+    skm_arm_playback_advance(&player_jump_down_playback, anim_step);
 
 
     // The world-space position of each bone should be something like:
     // model matrix * bone matrix * inverse bind matrix * position
+    skm_build_palette(&player_instance);
+    skm_palette_atlas_upload(&skin_atlas);
 
-    for(int i = 0; i < player_mesh.bone_count; ++i) {
-        mat4 final_transform;
-
-        glm_mat4_mul(player_mesh.bone_pose[i], player_mesh.bone_inverse_bind[i], final_transform);
-
-        skm_set_bone_global_transform(&player_mesh, i, final_transform);
-        
-    }
-
-    skm_gl_upload_bone_tform(&player_mesh);
+    anim_stats_last_tick = skm_anim_stats;
+    if(act_just_pressed(&act_stats)) show_stats = !show_stats;
 }
 
 void
 render_carrots() {
+    // Eaten carrots shrink to nothing and stay that way, so there's no point
+    // drawing them.
+    if(carrot_instancing) {
+        size_t count = 0;
+        for(size_t i = 0; i < carrot_count; ++i) {
+            if(carrots[i].scale <= 0.0) continue;
+
+            carrot_instances[count++] = (struct stm_instance){
+                .x = carrots[i].position[0],
+                .y = carrots[i].position[1],
+                .rotation = carrots[i].rotation,
+                .scale = carrots[i].scale,
+            };
+        }
+
+        stm_gl_draw_instanced(&carrot_mesh, carrot_instance_buf, carrot_instances, count);
+        return;
+    }
+
     for(size_t i = 0; i < carrot_count; ++i) {
+        if(carrots[i].scale <= 0.0) continue;
+
         mat4 tform;
 
         glm_scale_make(tform, (vec3){ carrots[i].scale, carrots[i].scale, carrots[i].scale });
@@ -890,7 +737,7 @@ render_carrots() {
         glm_translated(tform, (vec3){ carrots[i].position[0], carrots[i].position[1], 0.0 });
 
         REPORT(glUniformMatrix4fv(static_pbr.m, 1, false, tform[0]));
-        REPORT(glDrawElements(GL_TRIANGLES, carrot_mesh.triangles_count, GL_UNSIGNED_INT, 0));
+        stm_gl_draw(&carrot_mesh);
 
     }
 }
@@ -907,37 +754,22 @@ render() {
 
     REPORT(glUniform1i(skel_pbr.albedo, 0));
 
-    skm_gl_draw(&player_mesh);
+    skm_gl_draw(&player_instance);
 
-    REPORT(glUseProgram(static_pbr.self));
-    glUniform1f(static_pbr.metallic, 0.0);
-    glUniform1f(static_pbr.perceptual_roughness, 0.7);
-    //glUniform3f(static_pbr.base_color, 246.0/255.0, 247.0/255.0, 146.0/255.0);
-    glUniform3f(static_pbr.base_color, 1.0, 1.0, 1.0);
+    // Vertex attributes are global state, not part of the buffer, so they
+    // have to be pointed at the carrot even though skm_gl_draw set them up.
+    // This also switches to carrot_mesh.shader.
+    struct static_shader *carrot_shader = carrot_instancing ? &static_inst_pbr : &static_pbr;
+    stm_gl_bind(&carrot_mesh);
+    glUniform1f(carrot_shader->metallic, 0.0);
+    glUniform1f(carrot_shader->perceptual_roughness, 0.7);
+    //glUniform3f(carrot_shader->base_color, 246.0/255.0, 247.0/255.0, 146.0/255.0);
+    glUniform3f(carrot_shader->base_color, 1.0, 1.0, 1.0);
 
     REPORT(glActiveTexture(GL_TEXTURE0));
     REPORT(glBindTexture(GL_TEXTURE_2D, carrot_tex));
 
-    REPORT(glUniform1i(static_pbr.albedo, 0));
-
-    REPORT(glBindBuffer(GL_ARRAY_BUFFER, carrot_mesh.array_buf));
-    REPORT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, carrot_mesh.element_buf));
-
-    // Apparently we have to glVertexAttribPointer even though we already did inside skm_gl_draw...?
-    REPORT(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, SKEL_MESH_4BYTES_COUNT * sizeof(float), (void*)0));
-    REPORT(glEnableVertexAttribArray(0));
-
-    REPORT(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, SKEL_MESH_4BYTES_COUNT * sizeof(float), (void*)(sizeof(float) * 3)));
-    REPORT(glEnableVertexAttribArray(1));
-
-    REPORT(glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, SKEL_MESH_4BYTES_COUNT * sizeof(float), (void*)(sizeof(float) * 6)));
-    REPORT(glEnableVertexAttribArray(2));
-
-    REPORT(glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, SKEL_MESH_4BYTES_COUNT * sizeof(float), (void*)(sizeof(float) * 10)));
-    REPORT(glEnableVertexAttribArray(3));
-
-    REPORT(glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, SKEL_MESH_4BYTES_COUNT * sizeof(float), (void*)(sizeof(float) * 14)));
-    REPORT(glEnableVertexAttribArray(4));
+    REPORT(glUniform1i(carrot_shader->albedo, 0));
 
     render_carrots();
 
@@ -945,36 +777,28 @@ render() {
 
 
 
-    REPORT(glBindBuffer(GL_ARRAY_BUFFER, level_mesh.array_buf));
-    REPORT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, level_mesh.element_buf));
-
-    REPORT(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, LEVEL_MESH_ATTRIBS * sizeof(float), (void*)0));
-    REPORT(glEnableVertexAttribArray(0));
-
-    REPORT(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, LEVEL_MESH_ATTRIBS * sizeof(float), (void*)(sizeof(float) * 3)));
-    REPORT(glEnableVertexAttribArray(1));
-
-    REPORT(glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, LEVEL_MESH_ATTRIBS * sizeof(float), (void*)(sizeof(float) * 6)));
-    REPORT(glEnableVertexAttribArray(4));
-
-    //SDL_Log("level mesh tri count: %u\n", level_mesh.triangle_count);
-
     REPORT(glUseProgram(static_pbr.self));
     glUniform1f(static_pbr.metallic, 0.0);
     glUniform1f(static_pbr.perceptual_roughness, 0.95);
     //glUniform3f(static_pbr.base_color, 246.0/255.0, 247.0/255.0, 146.0/255.0);
     glUniform3f(static_pbr.base_color, 1.0, 1.0, 1.0);
 
-    // hay bales are drawn with an identity matrix.
+    // hay bales are drawn with an identity matrix, and float positions.
     mat4 identity = GLM_MAT4_IDENTITY_INIT;
     REPORT(glUniformMatrix4fv(static_pbr.m, 1, false, identity[0]));
+    REPORT(glUniform1f(static_pbr.pos_scale, 1.0f));
 
     REPORT(glActiveTexture(GL_TEXTURE0));
     REPORT(glBindTexture(GL_TEXTURE_2D, hay_tex));
 
     REPORT(glUniform1i(static_pbr.albedo, 0));
 
-    REPORT(glDrawElements(GL_TRIANGLES, level_mesh.triangle_count, GL_UNSIGNED_INT, 0));
+    // Picks up whatever map_set changed since the last frame.
+    level_mesh_update(&level_mesh);
+
+    mat4 vp;
+    glm_mat4_mul(p_matrix, v_matrix, vp);
+    level_mesh_draw(&level_mesh, vp, &level_stats_last_frame);
 }
 
 void
@@ -1046,4 +870,27 @@ ui(struct nk_context *ctx, int win_width, int win_height) {
         nk_label(ctx, buf, NK_TEXT_LEFT);
 	}
 	nk_end(ctx);
+
+    if(show_stats) {
+        // Tall enough for every row, without a scrollbar to fall back on.
+        const int stats_rows = 2;
+        const float stats_row_height = 30;
+        struct nk_style_window *stats_style = &ctx->style.window;
+        float stats_height = stats_rows * stats_row_height
+            + (stats_rows - 1) * stats_style->spacing.y + 2 * stats_style->padding.y;
+
+        if(nk_begin(ctx, "stats", nk_rect(0, 0, width, stats_height), NK_WINDOW_NO_SCROLLBAR)) {
+            nk_layout_row_dynamic(ctx, stats_row_height, 1);
+            char buf[128] = {0};
+            snprintf(buf, 128, "anim: %zu playbacks / %zu bones sampled per tick",
+                anim_stats_last_tick.playbacks_sampled, anim_stats_last_tick.bones_sampled);
+            nk_label(ctx, buf, NK_TEXT_LEFT);
+
+            snprintf(buf, 128, "level: %zu/%zu chunks, %zu triangles drawn",
+                level_stats_last_frame.chunks_drawn, level_stats_last_frame.chunks_total,
+                level_stats_last_frame.triangles);
+            nk_label(ctx, buf, NK_TEXT_LEFT);
+        }
+        nk_end(ctx);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,79 @@
+#version 100
+precision highp float;
+
+attribute vec3 a_pos;
+attribute vec3 a_norm;
+
+// Skeleton weights. We blend the dual quaternions of the bones they refer to.
+attribute vec4 a_weight;
+attribute vec4 a_weight_idx;
+
+attribute vec2 a_uv;
+
+varying vec3 v_norm; // Eye space
+varying vec3 v_pos;
+
+varying vec2 v_uv;
+
+// View matrix. Used to translate stuff to eye space
+uniform mat4 u_v;
+// Projection matrix
+uniform mat4 u_p;
+
+// a_pos comes in as snorm16; this brings it back to model units.
+uniform float u_pos_scale;
+
+// Bone dual quaternions, for every instance: one row per bone (see
+// skm_palette_atlas), two texels per bone: the real part, then the dual part.
+uniform sampler2D u_skeleton;
+// Number of rows in u_skeleton.
+uniform float     u_skeleton_count;
+// The row of this instance's first bone.
+uniform float     u_skeleton_row;
+
+vec4 skin_real;
+vec4 skin_dual;
+
+void
+add_skeleton(float idx, float weight) {
+    float y = (u_skeleton_row + idx + 0.5) / u_skeleton_count;
+    vec4 real = texture2D(u_skeleton, vec2(0.25, y));
+    vec4 dual = texture2D(u_skeleton, vec2(0.75, y));
+
+    // q and -q are the same rotation, but blending them cancels out. Keep
+    // every bone on the same side as what has been blended so far.
+    if(dot(real, skin_real) < 0.0) weight = -weight;
+
+    skin_real += real * weight;
+    skin_dual += dual * weight;
+}
+
+void main() {
+    skin_real = vec4(0.0);
+    skin_dual = vec4(0.0);
+    add_skeleton(a_weight_idx.x, a_weight.x);
+    add_skeleton(a_weight_idx.y, a_weight.y);
+    add_skeleton(a_weight_idx.z, a_weight.z);
+    add_skeleton(a_weight_idx.w, a_weight.w);
+
+    float len = length(skin_real);
+    vec3 r = skin_real.xyz / len;
+    float rw = skin_real.w / len;
+    vec3 d = skin_dual.xyz / len;
+    float dw = skin_dual.w / len;
+
+    // Rotate by the real part, then translate by 2 * dual * conjugate(real).
+    vec3 pos = a_pos * u_pos_scale;
+    vec3 world_pos = pos + 2.0 * cross(r, cross(r, pos) + rw * pos);
+    world_pos += 2.0 * (rw * d - dw * r + cross(r, d));
+    vec3 world_norm = a_norm + 2.0 * cross(r, cross(r, a_norm) + rw * a_norm);
+
+    v_norm = (u_v * vec4(world_norm, 0.0)).xyz;
+    
+    vec4 eye_space = u_v * vec4(world_pos, 1.0);
+    v_pos = eye_space.xyz;
+
+    v_uv = a_uv;
+
+    gl_Position = u_p * eye_space;
+}
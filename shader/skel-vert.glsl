@@ -20,32 +20,49 @@ varying vec2 v_uv;
 uniform mat4 u_v;
 // Projection matrix
 uniform mat4 u_p;
+
+// a_pos comes in as snorm16; this brings it back to model units.
+uniform float u_pos_scale;
 // uniform mat4 u_m;
 
-// Bone matrices.
+// Bone matrices, for every instance: one row per bone (see skm_palette_atlas).
 uniform sampler2D u_skeleton;
+// Number of rows in u_skeleton.
 uniform float     u_skeleton_count;
+// The row of this instance's first bone.
+uniform float     u_skeleton_row;
 
-mat4
-read_skeleton(float idx) {
-    float y = (idx + 0.5) / u_skeleton_count;
-    vec4 col0 = texture2D(u_skeleton, vec2(0.125, y));
-    vec4 col1 = texture2D(u_skeleton, vec2(0.375, y));
-    vec4 col2 = texture2D(u_skeleton, vec2(0.625, y));
-    vec4 col3 = texture2D(u_skeleton, vec2(0.875, y));
+// Each bone is three texels, holding the top three rows of its matrix (the
+// last row is always 0, 0, 0, 1). The weighted sum of the bones is done on
+// the rows, and the rows are applied with dot products.
+vec4 skin_row0;
+vec4 skin_row1;
+vec4 skin_row2;
 
-    return mat4(col0, col1, col2, col3);
+void
+add_skeleton(float idx, float weight) {
+    float y = (u_skeleton_row + idx + 0.5) / u_skeleton_count;
+    skin_row0 += texture2D(u_skeleton, vec2(1.0 / 6.0, y)) * weight;
+    skin_row1 += texture2D(u_skeleton, vec2(3.0 / 6.0, y)) * weight;
+    skin_row2 += texture2D(u_skeleton, vec2(5.0 / 6.0, y)) * weight;
 }
 
 void main() {
-    mat4 model_matrix = (read_skeleton(a_weight_idx.x) * a_weight.x)
-                      + (read_skeleton(a_weight_idx.y) * a_weight.y)
-                      + (read_skeleton(a_weight_idx.z) * a_weight.z)
-                      + (read_skeleton(a_weight_idx.w) * a_weight.w);
+    skin_row0 = vec4(0.0);
+    skin_row1 = vec4(0.0);
+    skin_row2 = vec4(0.0);
+    add_skeleton(a_weight_idx.x, a_weight.x);
+    add_skeleton(a_weight_idx.y, a_weight.y);
+    add_skeleton(a_weight_idx.z, a_weight.z);
+    add_skeleton(a_weight_idx.w, a_weight.w);
+
+    vec4 pos = vec4(a_pos * u_pos_scale, 1.0);
+    vec3 world_pos = vec3(dot(skin_row0, pos), dot(skin_row1, pos), dot(skin_row2, pos));
+    vec3 world_norm = vec3(dot(skin_row0.xyz, a_norm), dot(skin_row1.xyz, a_norm), dot(skin_row2.xyz, a_norm));
 
-    v_norm = (u_v * model_matrix * vec4(a_norm, 0.0)).xyz; // cheap approx
+    v_norm = (u_v * vec4(world_norm, 0.0)).xyz; // cheap approx
     
-    vec4 eye_space = u_v * model_matrix * vec4(a_pos, 1.0);
+    vec4 eye_space = u_v * vec4(world_pos, 1.0);
     v_pos = eye_space.xyz;
 
     v_uv = a_uv;
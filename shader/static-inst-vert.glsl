@@ -0,0 +1,44 @@
+#version 100
+precision highp float;
+
+attribute vec3 a_pos;
+attribute vec3 a_norm;
+
+attribute vec2 a_uv;
+
+// One per copy (see stm_instance): x, y, rotation around y, scale. Replaces
+// u_m, which the copies would otherwise need one draw call each to change.
+attribute vec4 a_instance;
+
+uniform mat4 u_v;
+uniform mat4 u_p;
+
+// See static-vert.glsl.
+uniform float u_pos_scale;
+
+varying vec3 v_norm;
+varying vec3 v_pos;
+
+varying vec2 v_uv;
+
+// The same rotation glm_rotated(m, angle, (vec3){ 0, 1, 0 }) makes.
+vec3 rotate_y(vec3 v, float c, float s) {
+    return vec3(c * v.x + s * v.z, v.y, -s * v.x + c * v.z);
+}
+
+void main() {
+    float c = cos(a_instance.z);
+    float s = sin(a_instance.z);
+
+    vec3 world = rotate_y(a_pos * (u_pos_scale * a_instance.w), c, s);
+    world.xy += a_instance.xy;
+
+    v_norm = (u_v * vec4(rotate_y(a_norm, c, s), 0.0)).xyz;
+
+    vec4 eye_space = u_v * vec4(world, 1.0);
+    v_pos = eye_space.xyz;
+
+    v_uv = a_uv;
+
+    gl_Position = u_p * eye_space;
+}
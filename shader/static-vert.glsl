@@ -12,6 +12,10 @@ uniform mat4 u_v;
 uniform mat4 u_p;
 uniform mat4 u_m;
 
+// Meshes with packed positions (see skm_packed_vertex) need their scale here;
+// float positions use 1.
+uniform float u_pos_scale;
+
 varying vec3 v_norm;
 varying vec3 v_pos;
 
@@ -22,7 +26,7 @@ void main() {
 
     v_norm = (vm * vec4(a_norm, 0.0)).xyz;
 
-    vec4 eye_space = vm * vec4(a_pos, 1.0);
+    vec4 eye_space = vm * vec4(a_pos * u_pos_scale, 1.0);
     v_pos = eye_space.xyz;
 
     v_uv = a_uv;
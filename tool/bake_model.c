@@ -0,0 +1,28 @@
+// Bakes models into the engine's own binary format (see engine/baked_model.h),
+// so that the game doesn't have to run assimp at startup.
+
+#include <stdio.h>
+
+#include "engine/model.h"
+
+void
+usage() {
+    puts("usage: bake_model <input.glb> <output.bake> [<input> <output>...]");
+}
+
+int
+main(int argc, char **argv) {
+    if(argc < 3 || (argc - 1) % 2 != 0) {
+        usage();
+        return 1;
+    }
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        if(!bake_model(argv[i], argv[i + 1])) {
+            printf("error: failed to bake %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
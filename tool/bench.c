@@ -0,0 +1,911 @@
+// Microbenchmarks for the parts of the engine that don't need a window or a
+// GL context. Run from the repository root:
+//
+//     ./build/engine-bench            # run everything
+//     ./build/engine-bench anim_step  # run only the named benchmarks
+
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL3/SDL_timer.h>
+
+#include "engine/model.h"
+#include "engine/serialize/serialize.h"
+#include "engine/alloc.h"
+
+#include "level.h"
+
+static double
+seconds_since(uint64_t start) {
+    return (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+}
+
+// --- synthetic animations ---
+
+// Makes an animation where every channel of every bone has key_count keys
+// evenly spread over length seconds.
+static void
+make_synthetic_anim(struct skeletal_mesh *skm, struct skm_armature_anim *anim, size_t bone_count, size_t key_count, float length) {
+    skm->bone_count = bone_count;
+
+    anim->skm = skm;
+    anim->length = length;
+    anim->bones = eng_zalloc(sizeof(*anim->bones) * bone_count);
+
+    for(size_t i = 0; i < bone_count; ++i) {
+        struct skm_arm_anim_bone *bone = &anim->bones[i];
+        bone->position = eng_zalloc(sizeof(*bone->position) * key_count);
+        bone->scale = eng_zalloc(sizeof(*bone->scale) * key_count);
+        bone->rotation = eng_zalloc(sizeof(*bone->rotation) * key_count);
+        bone->position_count = key_count;
+        bone->scale_count = key_count;
+        bone->rotation_count = key_count;
+
+        for(size_t k = 0; k < key_count; ++k) {
+            float time = length * (float)k / (float)key_count;
+            float wobble = sinf(time + (float)i);
+
+            bone->position[k].time = time;
+            glm_vec3_copy((vec3){ wobble, 0.0f, (float)i }, bone->position[k].value);
+
+            bone->scale[k].time = time;
+            glm_vec3_copy((vec3){ 1.0f, 1.0f, 1.0f }, bone->scale[k].value);
+
+            bone->rotation[k].time = time;
+            glm_quat_copy((versor){ 0.0f, wobble * 0.5f, 0.0f, 1.0f }, bone->rotation[k].value);
+            glm_quat_normalize(bone->rotation[k].value);
+        }
+    }
+}
+
+static void
+free_synthetic_anim(struct skm_armature_anim *anim, size_t bone_count) {
+    for(size_t i = 0; i < bone_count; ++i) {
+        struct skm_arm_anim_bone *bone = &anim->bones[i];
+        eng_free(bone->position, sizeof(*bone->position) * bone->position_count);
+        eng_free(bone->scale, sizeof(*bone->scale) * bone->scale_count);
+        eng_free(bone->rotation, sizeof(*bone->rotation) * bone->rotation_count);
+    }
+    eng_free(anim->bones, sizeof(*anim->bones) * bone_count);
+}
+
+// --- benchmarks ---
+
+// Per-tick cost of stepping a looping playback, versus seeking to the same
+// time from scratch every tick (which is what stepping used to do).
+static void
+bench_anim_step(void) {
+    const size_t bone_count = 25; // same as the horse
+    const size_t key_counts[] = { 8, 64, 512, 4096, 32768 };
+    const int ticks = 20000;
+    const float dt = 1.0f / 60.0f;
+    const float length = 10.0f;
+
+    printf("anim_step: %zu bones, %d ticks at 60Hz, looping a %.0fs clip\n", bone_count, ticks, length);
+    printf("  %8s %14s %14s\n", "keys", "step ns/tick", "seek ns/tick");
+
+    for(size_t k = 0; k < sizeof(key_counts) / sizeof(key_counts[0]); ++k) {
+        struct skeletal_mesh skm = {0};
+        struct skm_armature_anim anim = {0};
+        make_synthetic_anim(&skm, &anim, bone_count, key_counts[k], length);
+
+        struct skm_armature_anim_playback playback = {0};
+        skm_arm_playback_init(&playback, &anim);
+        skm_arm_playback_set_loop(&playback, 0.0f, length);
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        for(int i = 0; i < ticks; ++i) {
+            skm_arm_playback_step(&playback, dt);
+        }
+        double step_time = seconds_since(start);
+
+        skm_arm_playback_seek(&playback, 0.0f);
+        start = SDL_GetPerformanceCounter();
+        for(int i = 0; i < ticks; ++i) {
+            skm_arm_playback_seek(&playback, fmodf((float)i * dt, length));
+        }
+        double seek_time = seconds_since(start);
+
+        printf("  %8zu %14.1f %14.1f\n", key_counts[k],
+            step_time * 1e9 / ticks, seek_time * 1e9 / ticks);
+
+        skm_arm_playback_free(&playback);
+        free_synthetic_anim(&anim, bone_count);
+    }
+}
+
+// Sampling a whole pose per tick from the per-bone (AoS) keys through a
+// playback, versus from a SoA clip with skm_soa_clip_sample.
+static void
+bench_anim_sample(void) {
+    const size_t bone_counts[] = { 25, 64, 256 };
+    const size_t key_count = 64;
+    const int ticks = 20000;
+    const float dt = 1.0f / 60.0f;
+    const float length = 10.0f;
+
+    printf("anim_sample: %zu keys per channel, %d ticks at 60Hz\n", key_count, ticks);
+    printf("  %8s %14s %14s %12s\n", "bones", "AoS ns/tick", "SoA ns/tick", "max diff");
+
+    for(size_t b = 0; b < sizeof(bone_counts) / sizeof(bone_counts[0]); ++b) {
+        size_t bone_count = bone_counts[b];
+        struct skeletal_mesh skm = {0};
+        struct skm_armature_anim anim = {0};
+        make_synthetic_anim(&skm, &anim, bone_count, key_count, length);
+
+        struct skm_armature_anim_playback playback = {0};
+        skm_arm_playback_init(&playback, &anim);
+        skm_arm_playback_set_loop(&playback, 0.0f, length);
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        for(int i = 0; i < ticks; ++i) {
+            skm_arm_playback_step(&playback, dt);
+        }
+        double aos_time = seconds_since(start);
+
+        struct skm_soa_clip clip;
+        struct skm_pose pose;
+        skm_soa_clip_init(&clip, &anim);
+        skm_pose_init(&pose, bone_count);
+        uint32_t *cursors = eng_zalloc(sizeof(*cursors) * 3 * bone_count);
+
+        float time = 0.0f;
+        start = SDL_GetPerformanceCounter();
+        for(int i = 0; i < ticks; ++i) {
+            time = fmodf(time + dt, length);
+            skm_soa_clip_sample(&clip, cursors, time, &pose);
+        }
+        double soa_time = seconds_since(start);
+
+        // Both end at the same time; rotations differ slightly since the
+        // playbacks slerp and the SoA sampler nlerps.
+        float max_error = 0.0f;
+        for(size_t i = 0; i < bone_count; ++i) {
+            for(size_t c = 0; c < 3; ++c) {
+                max_error = fmaxf(max_error, fabsf(pose.position[i][c] - playback.pose.position[i][c]));
+            }
+            float dot = glm_quat_dot(pose.rotation[i], playback.pose.rotation[i]);
+            for(size_t c = 0; c < 4; ++c) {
+                float q = playback.pose.rotation[i][c] * (dot < 0.0f ? -1.0f : 1.0f);
+                max_error = fmaxf(max_error, fabsf(pose.rotation[i][c] - q));
+            }
+        }
+
+        printf("  %8zu %14.1f %14.1f %12g\n", bone_count,
+            aos_time * 1e9 / ticks, soa_time * 1e9 / ticks, max_error);
+
+        eng_free(cursors, sizeof(*cursors) * 3 * bone_count);
+        skm_pose_free(&pose);
+        skm_soa_clip_free(&clip);
+        skm_arm_playback_free(&playback);
+        free_synthetic_anim(&anim, bone_count);
+    }
+}
+
+// Memory and per-tick cost of a resampled, quantized clip versus the original
+// keys, and how far the quantized poses are from the original ones.
+static void
+bench_anim_quantized(void) {
+    const size_t bone_count = 25;
+    const size_t key_counts[] = { 60, 240, 300 }; // keyed at 6, 24 and 30 fps
+    const float frame_rate = 30.0f;
+    const int ticks = 20000;
+    const float dt = 1.0f / 60.0f;
+    const float length = 10.0f;
+
+    printf("anim_quantized: %zu bones, %.0fs clip resampled at %.0f fps, %d ticks at 60Hz\n", bone_count, length, frame_rate, ticks);
+    printf("  %6s %10s %10s %12s %12s %10s %10s\n", "keys", "key bytes", "qnt bytes", "keys ns/tick", "qnt ns/tick", "max pos", "max rot");
+
+    for(size_t k = 0; k < sizeof(key_counts) / sizeof(key_counts[0]); ++k) {
+        struct skeletal_mesh skm = {0};
+        struct skm_armature_anim anim = {0};
+        make_synthetic_anim(&skm, &anim, bone_count, key_counts[k], length);
+
+        struct skm_armature_anim_playback playback = {0};
+        skm_arm_playback_init(&playback, &anim);
+        skm_arm_playback_set_loop(&playback, 0.0f, length);
+
+        struct skm_quantized_clip clip;
+        struct skm_pose pose;
+        skm_quantized_clip_init(&clip, &anim, frame_rate);
+        skm_pose_init(&pose, bone_count);
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        for(int i = 0; i < ticks; ++i) {
+            skm_arm_playback_step(&playback, dt);
+        }
+        double keys_time = seconds_since(start);
+
+        float time = 0.0f;
+        start = SDL_GetPerformanceCounter();
+        for(int i = 0; i < ticks; ++i) {
+            time = fmodf(time + dt, length);
+            skm_quantized_clip_sample(&clip, time, &pose);
+        }
+        double quantized_time = seconds_since(start);
+
+        // Compare against the original keys at a spread of times, including
+        // ones between frames.
+        float max_pos = 0.0f, max_rot = 0.0f;
+        for(int i = 0; i < 997; ++i) {
+            float t = length * (float)i / 997.0f;
+            skm_arm_playback_seek(&playback, t);
+            skm_quantized_clip_sample(&clip, t, &pose);
+
+            for(size_t b = 0; b < bone_count; ++b) {
+                max_pos = fmaxf(max_pos, glm_vec3_distance(pose.position[b], playback.pose.position[b]));
+                float dot = fabsf(glm_quat_dot(pose.rotation[b], playback.pose.rotation[b]));
+                max_rot = fmaxf(max_rot, 1.0f - fminf(dot, 1.0f));
+            }
+        }
+
+        printf("  %6zu %10zu %10zu %12.1f %12.1f %10.2g %10.2g\n", key_counts[k],
+            skm_anim_key_bytes(&anim), skm_quantized_clip_bytes(&clip),
+            keys_time * 1e9 / ticks, quantized_time * 1e9 / ticks, max_pos, max_rot);
+
+        skm_pose_free(&pose);
+        skm_quantized_clip_free(&clip);
+        skm_arm_playback_free(&playback);
+        free_synthetic_anim(&anim, bone_count);
+    }
+    printf("  (max rot is 1 - |dot| between the two rotations)\n");
+}
+
+// How script.c used to blend two playbacks: slerp per bone, then three
+// matrices and two matrix multiplies per bone.
+static void
+matrix_blend(struct skm_pose *a, struct skm_pose *b, float blend, mat4 *out) {
+    for(size_t i = 0; i < a->bone_count; ++i) {
+        mat4 translate_matrix, rotate_matrix, scale_matrix;
+        vec3 pos;
+        versor rot;
+
+        glm_vec3_lerp(a->position[i], b->position[i], blend, pos);
+        glm_quat_slerp(a->rotation[i], b->rotation[i], blend, rot);
+        glm_quat_normalize(rot);
+
+        glm_translate_make(translate_matrix, pos);
+        glm_quat_mat4(rot, rotate_matrix);
+        glm_scale_make(scale_matrix, a->scale[i]);
+
+        glm_mat4_copy(scale_matrix, out[i]);
+        glm_mat4_mul(rotate_matrix, out[i], out[i]);
+        glm_mat4_mul(translate_matrix, out[i], out[i]);
+    }
+}
+
+// Blending sampled poses into local matrices: the old two-way matrix path
+// versus skm_pose_blend + skm_pose_compose with two and four layers.
+static void
+bench_pose_blend(void) {
+    const size_t bone_counts[] = { 25, 256 };
+    const int iterations = 20000;
+
+    printf("pose_blend: %d iterations\n", iterations);
+    printf("  %8s %14s %14s %14s %10s\n", "bones", "old 2-way ns", "pose 2-way ns", "pose 4-way ns", "max diff");
+
+    for(size_t b = 0; b < sizeof(bone_counts) / sizeof(bone_counts[0]); ++b) {
+        size_t bone_count = bone_counts[b];
+        struct skm_pose poses[4], out;
+        for(size_t p = 0; p < 4; ++p) {
+            skm_pose_init(&poses[p], bone_count);
+            for(size_t i = 0; i < bone_count; ++i) {
+                glm_vec3_copy((vec3){ (float)p, 0.1f * (float)i, 0.0f }, poses[p].position[i]);
+                glm_quatv(poses[p].rotation[i], 0.3f * (float)p + 0.01f * (float)i, (vec3){ 0.0f, 0.0f, 1.0f });
+            }
+        }
+        skm_pose_init(&out, bone_count);
+
+        mat4 *old_matrices = eng_zalloc(sizeof(mat4) * bone_count);
+        mat4 *new_matrices = eng_zalloc(sizeof(mat4) * bone_count);
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        for(int it = 0; it < iterations; ++it) {
+            matrix_blend(&poses[0], &poses[1], 0.25f, old_matrices);
+        }
+        double old_time = seconds_since(start);
+
+        struct skm_pose_layer layers[4] = {
+            { &poses[0], 0.75f, NULL }, { &poses[1], 0.25f, NULL },
+            { &poses[2], 0.5f, NULL }, { &poses[3], 0.5f, NULL },
+        };
+
+        start = SDL_GetPerformanceCounter();
+        for(int it = 0; it < iterations; ++it) {
+            skm_pose_blend(&out, layers, 2);
+            skm_pose_compose(&out, new_matrices);
+        }
+        double two_time = seconds_since(start);
+
+        float max_error = 0.0f;
+        for(size_t i = 0; i < bone_count * 16; ++i) {
+            max_error = fmaxf(max_error, fabsf(((float*)old_matrices)[i] - ((float*)new_matrices)[i]));
+        }
+
+        start = SDL_GetPerformanceCounter();
+        for(int it = 0; it < iterations; ++it) {
+            skm_pose_blend(&out, layers, 4);
+            skm_pose_compose(&out, new_matrices);
+        }
+        double four_time = seconds_since(start);
+
+        printf("  %8zu %14.1f %14.1f %14.1f %10.2g\n", bone_count,
+            old_time * 1e9 / iterations, two_time * 1e9 / iterations, four_time * 1e9 / iterations, max_error);
+
+        eng_free(new_matrices, sizeof(mat4) * bone_count);
+        eng_free(old_matrices, sizeof(mat4) * bone_count);
+        skm_pose_free(&out);
+        for(size_t p = 0; p < 4; ++p) skm_pose_free(&poses[p]);
+    }
+    printf("  (max diff is between the old and new 2-way matrices: slerp vs nlerp)\n");
+}
+
+// --- crowds ---
+
+// The full per-tick CPU cost of 500 animated horses sharing one mesh: each has
+// its own playback (at its own point in the clip) and skm_instance, and goes
+// through sample, compose, skm_compute_matrices and skm_build_palette into a
+// shared palette atlas.
+static void
+bench_horde(void) {
+    const size_t horse_count = 500;
+    const size_t bone_count = 25; // same as the horse
+    const size_t vertex_count = 4000;
+    const size_t key_count = 64;
+    const int ticks = 600;
+    const float dt = 1.0f / 60.0f;
+    const float length = 10.0f;
+
+    struct skeletal_mesh skm = {0};
+    struct skm_armature_anim anim = {0};
+    make_synthetic_anim(&skm, &anim, bone_count, key_count, length);
+
+    skm.vertices_count = vertex_count * SKEL_MESH_4BYTES_COUNT;
+    skm.vertices = eng_zalloc(sizeof(float) * skm.vertices_count);
+    skm.bone_inverse_bind = eng_zalloc(sizeof(mat4) * bone_count);
+    skm.bone_local_pose = eng_zalloc(sizeof(mat4) * bone_count);
+    skm.bone_heirarchy = eng_zalloc(sizeof(int32_t) * bone_count);
+    for(size_t i = 0; i < bone_count; ++i) {
+        skm.bone_heirarchy[i] = (int32_t)i - 1;
+        glm_mat4_identity(skm.bone_local_pose[i]);
+        glm_translate_make(skm.bone_inverse_bind[i], (vec3){ 0.0f, -0.1f * (float)i, 0.0f });
+    }
+
+    struct skm_palette_atlas atlas = {0};
+    skm_palette_atlas_init(&atlas, horse_count * bone_count, SKM_PALETTE_TEXELS);
+
+    struct skm_instance *horses = eng_zalloc(sizeof(*horses) * horse_count);
+    struct skm_armature_anim_playback *playbacks = eng_zalloc(sizeof(*playbacks) * horse_count);
+    mat4 *roots = eng_zalloc(sizeof(mat4) * horse_count);
+    for(size_t h = 0; h < horse_count; ++h) {
+        skm_instance_init(&horses[h], &skm);
+        skm_palette_atlas_add(&atlas, &horses[h]);
+        skm_arm_playback_init(&playbacks[h], &anim);
+        skm_arm_playback_set_loop(&playbacks[h], 0.0f, length);
+        skm_arm_playback_seek(&playbacks[h], length * (float)h / (float)horse_count);
+        glm_translate_make(roots[h], (vec3){ (float)(h % 25), (float)(h / 25), 0.0f });
+    }
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    for(int t = 0; t < ticks; ++t) {
+        for(size_t h = 0; h < horse_count; ++h) {
+            skm_arm_playback_step(&playbacks[h], dt);
+            skm_arm_playback_apply(&playbacks[h], &horses[h]);
+            skm_compute_matrices(&horses[h], roots[h]);
+            skm_build_palette(&horses[h]);
+        }
+    }
+    double time = seconds_since(start);
+
+    size_t mesh_bytes = sizeof(float) * skm.vertices_count
+        + sizeof(mat4) * bone_count * 2 + sizeof(int32_t) * bone_count;
+    size_t instance_bytes = sizeof(struct skm_instance) + sizeof(mat4) * bone_count * 2
+        + sizeof(float) * SKM_PALETTE_FLOATS * bone_count;
+
+    printf("horde: %zu horses, %zu bones, %zu vertices, %d ticks\n", horse_count, bone_count, vertex_count, ticks);
+    printf("  per tick             %10.3f ms\n", time * 1e3 / ticks);
+    printf("  per horse            %10.1f ns\n", time * 1e9 / ticks / horse_count);
+    printf("  atlas rows to upload %10zu (of %zu), in 1 call\n", atlas.dirty_end - atlas.dirty_first, atlas.rows);
+    printf("  shared mesh          %10zu bytes\n", mesh_bytes);
+    printf("  per instance         %10zu bytes\n", instance_bytes);
+    printf("  all horses           %10.1f KB (%.1f KB as separate meshes)\n",
+        (mesh_bytes + instance_bytes * horse_count) / 1024.0,
+        (mesh_bytes + instance_bytes) * horse_count / 1024.0);
+
+    for(size_t h = 0; h < horse_count; ++h) {
+        skm_arm_playback_free(&playbacks[h]);
+        skm_instance_free(&horses[h]);
+    }
+    skm_palette_atlas_free(&atlas);
+    eng_free(roots, sizeof(mat4) * horse_count);
+    eng_free(playbacks, sizeof(*playbacks) * horse_count);
+    eng_free(horses, sizeof(*horses) * horse_count);
+    eng_free(skm.bone_heirarchy, sizeof(int32_t) * bone_count);
+    eng_free(skm.bone_local_pose, sizeof(mat4) * bone_count);
+    eng_free(skm.bone_inverse_bind, sizeof(mat4) * bone_count);
+    eng_free(skm.vertices, sizeof(float) * skm.vertices_count);
+    free_synthetic_anim(&anim, bone_count);
+}
+
+// --- vertex formats ---
+
+// Packing a horse-sized mesh into skm_packed_vertex: how much smaller the
+// vertex buffer gets (which is what the vertex shader fetches), and how much
+// precision that costs.
+static void
+bench_vertex_pack(void) {
+    const size_t vertex_count = 7498; // same as the horse
+    const int iterations = 200;
+
+    float *vertices = eng_zalloc(sizeof(float) * SKEL_MESH_4BYTES_COUNT * vertex_count);
+    struct skm_packed_vertex *packed = eng_zalloc(sizeof(*packed) * vertex_count);
+
+    srand(1234);
+    for(size_t i = 0; i < vertex_count; ++i) {
+        float *v = vertices + i * SKEL_MESH_4BYTES_COUNT;
+        for(size_t k = 0; k < 3; ++k) v[k] = 2.0f * ((float)rand() / (float)RAND_MAX) - 1.0f;
+
+        vec3 n = { v[1], v[2] + 0.1f, v[0] };
+        glm_vec3_normalize(n);
+        glm_vec3_copy(n, &v[3]);
+
+        float total = 0.0f;
+        for(size_t k = 0; k < 4; ++k) {
+            v[6 + k] = (float)rand() / (float)RAND_MAX;
+            v[10 + k] = (float)(rand() % 25);
+            total += v[6 + k];
+        }
+        for(size_t k = 0; k < 4; ++k) v[6 + k] /= total;
+
+        v[14] = (float)rand() / (float)RAND_MAX;
+        v[15] = (float)rand() / (float)RAND_MAX;
+    }
+
+    float scale = 0.0f;
+    uint64_t start = SDL_GetPerformanceCounter();
+    for(int it = 0; it < iterations; ++it) {
+        scale = skm_pack_vertices(vertices, vertex_count, packed);
+    }
+    double time = seconds_since(start);
+
+    float max_pos = 0.0f, max_norm = 0.0f, max_weight = 0.0f, max_uv = 0.0f;
+    int bad_sums = 0;
+    for(size_t i = 0; i < vertex_count; ++i) {
+        const float *v = vertices + i * SKEL_MESH_4BYTES_COUNT;
+        const struct skm_packed_vertex *p = &packed[i];
+        int sum = 0;
+        for(size_t k = 0; k < 3; ++k) {
+            max_pos = fmaxf(max_pos, fabsf(p->position[k] / 32767.0f * scale - v[k]));
+            max_norm = fmaxf(max_norm, fabsf(p->normal[k] / 127.0f - v[3 + k]));
+        }
+        for(size_t k = 0; k < 4; ++k) {
+            max_weight = fmaxf(max_weight, fabsf(p->weight[k] / 255.0f - v[6 + k]));
+            if(p->bone[k] != (uint8_t)v[10 + k]) bad_sums++;
+            sum += p->weight[k];
+        }
+        if(sum != 255) bad_sums++;
+        max_uv = fmaxf(max_uv, fabsf(p->uv[0] / 65535.0f - v[14]));
+        max_uv = fmaxf(max_uv, fabsf(p->uv[1] / 65535.0f - v[15]));
+    }
+
+    printf("vertex_pack: %zu vertices, %d iterations\n", vertex_count, iterations);
+    printf("  float vertex         %10zu bytes (%zu KB per mesh)\n",
+        sizeof(float) * SKEL_MESH_4BYTES_COUNT, sizeof(float) * SKEL_MESH_4BYTES_COUNT * vertex_count / 1024);
+    printf("  packed vertex        %10zu bytes (%zu KB per mesh)\n",
+        sizeof(struct skm_packed_vertex), sizeof(struct skm_packed_vertex) * vertex_count / 1024);
+    printf("  skm_pack_vertices    %10.1f us/call\n", time * 1e6 / iterations);
+    printf("  max error: position %g, normal %g, weight %g, uv %g\n", max_pos, max_norm, max_weight, max_uv);
+    printf("  bad bone indices or weight sums: %d\n", bad_sums);
+
+    eng_free(packed, sizeof(*packed) * vertex_count);
+    eng_free(vertices, sizeof(float) * SKEL_MESH_4BYTES_COUNT * vertex_count);
+}
+
+// --- bone hierarchies ---
+
+// How skm_compute_matrices used to work: a recursive walk up to the root from
+// every bone, with a visited flag per bone, since bones could come in any
+// order.
+static void
+dfs_compute(struct skm_instance *inst, bool *visited, int idx, mat4 root_pose) {
+    if(idx == -1 || visited[idx]) return;
+    visited[idx] = true;
+
+    mat4 parent_matrix;
+    int parent_idx = inst->skm->bone_heirarchy[idx];
+    if(parent_idx < 0) {
+        glm_mat4_copy(root_pose, parent_matrix);
+    }
+    else {
+        dfs_compute(inst, visited, parent_idx, root_pose);
+        glm_mat4_copy(inst->bone_pose[parent_idx], parent_matrix);
+    }
+
+    glm_mat4_mul(parent_matrix, inst->bone_local_pose[idx], inst->bone_pose[idx]);
+}
+
+static void
+dfs_compute_matrices(struct skm_instance *inst, bool *visited, mat4 root_pose) {
+    for(size_t i = 0; i < inst->skm->bone_count; ++i) visited[i] = false;
+    for(size_t i = 0; i < inst->skm->bone_count; ++i) dfs_compute(inst, visited, (int)i, root_pose);
+}
+
+// Pose computation on a 256-bone rig: the recursive walk on bones in
+// arbitrary order, versus the linear pass on bones sorted parents first.
+static void
+bench_bone_pose(void) {
+    const size_t bone_count = 256;
+    const int iterations = 20000;
+
+    struct skeletal_mesh sorted_mesh = {0}, shuffled_mesh = {0};
+    struct skeletal_mesh *rigs[] = { &sorted_mesh, &shuffled_mesh };
+    struct skm_instance sorted = {0}, shuffled = {0};
+    int *order = eng_zalloc(sizeof(*order) * bone_count);
+    int *remap = eng_zalloc(sizeof(*remap) * bone_count);
+    bool *visited = eng_zalloc(sizeof(*visited) * bone_count);
+
+    // A random tree, with parents before children, and the same tree with
+    // its bones shuffled.
+    srand(1234);
+    for(size_t i = 0; i < bone_count; ++i) order[i] = (int)i;
+    for(size_t i = bone_count - 1; i > 0; --i) {
+        size_t j = (size_t)rand() % (i + 1);
+        int tmp = order[i]; order[i] = order[j]; order[j] = tmp;
+    }
+    for(size_t i = 0; i < bone_count; ++i) remap[order[i]] = (int)i;
+
+    for(size_t r = 0; r < 2; ++r) {
+        rigs[r]->bone_count = bone_count;
+        rigs[r]->bone_heirarchy = eng_zalloc(sizeof(int32_t) * bone_count);
+        rigs[r]->bone_local_pose = eng_zalloc(sizeof(mat4) * bone_count);
+    }
+
+    for(size_t i = 0; i < bone_count; ++i) {
+        int parent = (i == 0) ? -1 : rand() % (int)i;
+        mat4 local;
+        glm_translate_make(local, (vec3){ 0.0f, 0.1f, 0.0f });
+        glm_rotate_z(local, 0.01f * (float)i, local);
+
+        sorted_mesh.bone_heirarchy[i] = parent;
+        glm_mat4_copy(local, sorted_mesh.bone_local_pose[i]);
+
+        shuffled_mesh.bone_heirarchy[remap[i]] = parent < 0 ? -1 : remap[parent];
+        glm_mat4_copy(local, shuffled_mesh.bone_local_pose[remap[i]]);
+    }
+    skm_instance_init(&sorted, &sorted_mesh);
+    skm_instance_init(&shuffled, &shuffled_mesh);
+
+    mat4 root;
+    glm_mat4_identity(root);
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    for(int i = 0; i < iterations; ++i) dfs_compute_matrices(&shuffled, visited, root);
+    double dfs_time = seconds_since(start);
+
+    start = SDL_GetPerformanceCounter();
+    for(int i = 0; i < iterations; ++i) skm_compute_matrices(&sorted, root);
+    double linear_time = seconds_since(start);
+
+    float max_error = 0.0f;
+    for(size_t i = 0; i < bone_count; ++i) {
+        for(size_t e = 0; e < 16; ++e) {
+            float diff = fabsf(((float*)sorted.bone_pose[i])[e] - ((float*)shuffled.bone_pose[remap[i]])[e]);
+            if(diff > max_error) max_error = diff;
+        }
+    }
+
+    printf("bone_pose: %zu bones, %d iterations\n", bone_count, iterations);
+    printf("  recursive (unsorted) %10.1f ns/call\n", dfs_time * 1e9 / iterations);
+    printf("  linear (sorted)      %10.1f ns/call\n", linear_time * 1e9 / iterations);
+    printf("  max difference       %10g\n", max_error);
+
+    skm_instance_free(&sorted);
+    skm_instance_free(&shuffled);
+    for(size_t r = 0; r < 2; ++r) {
+        eng_free(rigs[r]->bone_heirarchy, sizeof(int32_t) * bone_count);
+        eng_free(rigs[r]->bone_local_pose, sizeof(mat4) * bone_count);
+    }
+    eng_free(visited, sizeof(*visited) * bone_count);
+    eng_free(remap, sizeof(*remap) * bone_count);
+    eng_free(order, sizeof(*order) * bone_count);
+}
+
+// Moves point p by bone i of a palette, the way the vertex shaders do.
+static void
+skin_point_matrix(const float *palette, size_t i, vec3 p, vec3 out) {
+    const float *rows = palette + i * SKM_PALETTE_FLOATS;
+    for(size_t r = 0; r < 3; ++r) {
+        out[r] = rows[r * 4 + 0] * p[0] + rows[r * 4 + 1] * p[1] + rows[r * 4 + 2] * p[2] + rows[r * 4 + 3];
+    }
+}
+
+static void
+skin_point_dual_quat(const float *palette, size_t i, vec3 p, vec3 out) {
+    const float *dq = palette + i * SKM_DQ_PALETTE_TEXELS * 4;
+    vec3 r = { dq[0], dq[1], dq[2] }, d = { dq[4], dq[5], dq[6] };
+    float rw = dq[3], dw = dq[7];
+
+    vec3 a, b;
+    glm_vec3_cross(r, p, a);
+    glm_vec3_muladds(p, rw, a);
+    glm_vec3_cross(r, a, b);
+    for(size_t k = 0; k < 3; ++k) out[k] = p[k] + 2.0f * b[k];
+
+    glm_vec3_cross(r, d, a);
+    for(size_t k = 0; k < 3; ++k) out[k] += 2.0f * (rw * d[k] - dw * r[k] + a[k]);
+}
+
+// Building the skinning palette for a 256-bone rig: one glm_mat4_mul and
+// skm_set_bone_global_transform per bone (what script.c used to do), versus
+// skm_build_palette, and skm_build_palette for dual quaternion skinning.
+static void
+bench_palette(void) {
+    const size_t bone_count = 256;
+    const int iterations = 20000;
+
+    struct skeletal_mesh skm = {0};
+    skm.bone_count = bone_count;
+    skm.bone_inverse_bind = eng_zalloc(sizeof(mat4) * bone_count);
+    skm.bone_local_pose = eng_zalloc(sizeof(mat4) * bone_count);
+    float *reference = eng_zalloc(sizeof(float) * SKM_PALETTE_FLOATS * bone_count);
+
+    struct skm_instance inst = {0};
+    skm_instance_init(&inst, &skm);
+
+    for(size_t i = 0; i < bone_count; ++i) {
+        glm_translate_make(inst.bone_pose[i], (vec3){ 0.0f, 0.1f * (float)i, 0.0f });
+        glm_rotate_z(inst.bone_pose[i], 0.01f * (float)i, inst.bone_pose[i]);
+        glm_translate_make(skm.bone_inverse_bind[i], (vec3){ 0.0f, -0.1f * (float)i, 0.5f });
+    }
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    for(int it = 0; it < iterations; ++it) {
+        for(size_t i = 0; i < bone_count; ++i) {
+            mat4 final_transform;
+            glm_mat4_mul(inst.bone_pose[i], skm.bone_inverse_bind[i], final_transform);
+            skm_set_bone_global_transform(&inst, (int)i, final_transform);
+        }
+    }
+    double per_bone_time = seconds_since(start);
+    memcpy(reference, inst.bone_tform_tex_data, sizeof(float) * SKM_PALETTE_FLOATS * bone_count);
+
+    start = SDL_GetPerformanceCounter();
+    for(int it = 0; it < iterations; ++it) {
+        skm_build_palette(&inst);
+    }
+    double batch_time = seconds_since(start);
+
+    float max_error = 0.0f;
+    for(size_t i = 0; i < bone_count * SKM_PALETTE_FLOATS; ++i) {
+        float diff = fabsf(reference[i] - inst.bone_tform_tex_data[i]);
+        if(diff > max_error) max_error = diff;
+    }
+
+    struct skeletal_mesh dq_skm = skm;
+    dq_skm.skinning = SKM_SKIN_DUAL_QUAT;
+    struct skm_instance dq = {0};
+    skm_instance_init(&dq, &dq_skm);
+    memcpy(dq.bone_pose, inst.bone_pose, sizeof(mat4) * bone_count);
+
+    start = SDL_GetPerformanceCounter();
+    for(int it = 0; it < iterations; ++it) {
+        skm_build_palette(&dq);
+    }
+    double dq_time = seconds_since(start);
+
+    // The rig is rigid, so both palettes should move points to the same place.
+    float max_dq_error = 0.0f;
+    for(size_t i = 0; i < bone_count; ++i) {
+        vec3 p = { 0.3f, -0.2f, 0.5f + 0.01f * (float)i }, m, q;
+        skin_point_matrix(inst.bone_tform_tex_data, i, p, m);
+        skin_point_dual_quat(dq.bone_tform_tex_data, i, p, q);
+        max_dq_error = fmaxf(max_dq_error, glm_vec3_distance(m, q));
+    }
+
+    printf("palette: %zu bones, %d iterations\n", bone_count, iterations);
+    printf("  per bone             %10.1f ns/call\n", per_bone_time * 1e9 / iterations);
+    printf("  skm_build_palette    %10.1f ns/call\n", batch_time * 1e9 / iterations);
+    printf("  max difference       %10g\n", max_error);
+    printf("  dual quaternions     %10.1f ns/call, %zu vs %d bytes per bone\n", dq_time * 1e9 / iterations,
+        sizeof(float) * SKM_DQ_PALETTE_TEXELS * 4, (int)(sizeof(float) * SKM_PALETTE_FLOATS));
+    printf("  max point distance   %10g\n", max_dq_error);
+
+    skm_instance_free(&dq);
+    skm_instance_free(&inst);
+    eng_free(reference, sizeof(float) * SKM_PALETTE_FLOATS * bone_count);
+    eng_free(skm.bone_inverse_bind, sizeof(mat4) * bone_count);
+    eng_free(skm.bone_local_pose, sizeof(mat4) * bone_count);
+}
+
+// --- serialization ---
+
+// Throughput of writing the vertex data of a 1M-vertex skeletal mesh, one
+// element at a time (what write_float_array used to do) versus the bulk path,
+// into memory, straight into a file, and into a file through a buffer.
+static void
+bench_serialize_write(void) {
+    const size_t vertex_count = 1000000;
+    const size_t float_count = vertex_count * SKEL_MESH_4BYTES_COUNT;
+    const char *tmp_path = "engine-bench.tmp";
+    const char *sink_names[] = { "memory", "file", "buffered" };
+    const double mb = (double)(float_count * sizeof(float)) / (1024.0 * 1024.0);
+
+    float *vertices = eng_zalloc(sizeof(*vertices) * float_count);
+    for(size_t i = 0; i < float_count; ++i) vertices[i] = (float)i * 0.001f;
+
+    printf("serialize_write: %zu vertices, %.1f MB\n", vertex_count, mb);
+    printf("  %-10s %14s %14s\n", "sink", "per-elem MB/s", "bulk MB/s");
+
+    for(int sink = 0; sink < 3; ++sink) {
+        double times[2];
+        for(int bulk = 0; bulk < 2; ++bulk) {
+            struct serializer *s = NULL;
+            if(sink == 0) s = get_memory_writer();
+            if(sink == 1) s = get_stdio_writer(tmp_path);
+            if(sink == 2) s = get_buffered_writer(get_stdio_writer(tmp_path));
+            if(!s) { printf("  could not open %s\n", tmp_path); goto done; }
+
+            uint64_t start = SDL_GetPerformanceCounter();
+            if(bulk) {
+                write_float_array(s, float_count, vertices);
+            }
+            else {
+                write_u64(s, float_count);
+                for(size_t i = 0; i < float_count; ++i) write_float(s, vertices[i]);
+            }
+            close_writer(s);
+            times[bulk] = seconds_since(start);
+        }
+
+        printf("  %-10s %14.1f %14.1f\n", sink_names[sink], mb / times[0], mb / times[1]);
+    }
+
+done:
+    remove(tmp_path);
+    eng_free(vertices, sizeof(*vertices) * float_count);
+}
+
+// --- level meshing ---
+
+// A stand-in for the hay bale: a cube reaching 1.04 out, with each side split
+// into grid * grid quads that don't share vertices with the other sides (so
+// 3072 triangles for a grid of 16, about what the real one has).
+static void
+make_synthetic_bale(struct static_mesh *stm, size_t grid) {
+    const float extent = 1.04f;
+    size_t side_vertices = (grid + 1) * (grid + 1);
+    size_t vertex_count = 6 * side_vertices;
+    size_t index_count = 6 * grid * grid * 6;
+
+    float *vertices = eng_zalloc(sizeof(float) * STATIC_MESH_4BYTES_COUNT * vertex_count);
+    uint32_t *triangles = eng_zalloc(sizeof(uint32_t) * index_count);
+
+    size_t v = 0, t = 0;
+    for(int face = 0; face < 6; ++face) {
+        int axis = face / 2;
+        float sign = (face & 1) ? -1.0f : 1.0f;
+        int u_axis = (axis + 1) % 3;
+        int v_axis = (axis + 2) % 3;
+        uint32_t base = (uint32_t)v;
+
+        for(size_t j = 0; j <= grid; ++j) {
+            for(size_t i = 0; i <= grid; ++i) {
+                float *out = vertices + v * STATIC_MESH_4BYTES_COUNT;
+                out[axis] = sign * extent;
+                out[u_axis] = extent * (2.0f * (float)i / (float)grid - 1.0f);
+                out[v_axis] = extent * (2.0f * (float)j / (float)grid - 1.0f);
+                out[3 + axis] = sign;
+                out[6] = (float)i / (float)grid;
+                out[7] = (float)j / (float)grid;
+                v += 1;
+            }
+        }
+
+        for(size_t j = 0; j < grid; ++j) {
+            for(size_t i = 0; i < grid; ++i) {
+                uint32_t a = base + (uint32_t)(j * (grid + 1) + i);
+                uint32_t b = a + 1;
+                uint32_t c = a + (uint32_t)(grid + 1);
+                uint32_t d = c + 1;
+                // Counter-clockwise seen from outside.
+                if(sign > 0) {
+                    triangles[t++] = a; triangles[t++] = b; triangles[t++] = d;
+                    triangles[t++] = a; triangles[t++] = d; triangles[t++] = c;
+                }
+                else {
+                    triangles[t++] = a; triangles[t++] = d; triangles[t++] = b;
+                    triangles[t++] = a; triangles[t++] = c; triangles[t++] = d;
+                }
+            }
+        }
+    }
+
+    stm_init(stm, vertices, STATIC_MESH_4BYTES_COUNT * vertex_count, triangles, index_count, 0);
+
+    eng_free(vertices, sizeof(float) * STATIC_MESH_4BYTES_COUNT * vertex_count);
+    eng_free(triangles, sizeof(uint32_t) * index_count);
+}
+
+static void
+print_level_size(const char *name, struct level_mesh *level, struct map *map) {
+    struct level_mesh_size before = level_mesh_measure(level, map, false);
+    uint64_t start = SDL_GetPerformanceCounter();
+    struct level_mesh_size after = level_mesh_measure(level, map, true);
+    double time = seconds_since(start);
+
+    printf("  %-10s %12zu %12zu %8.1f%% %9.1f MB %9.1f MB %8.1f ms\n", name,
+        before.triangles, after.triangles,
+        100.0 * (1.0 - (double)after.triangles / (double)before.triangles),
+        before.vertex_bytes / (1024.0 * 1024.0), after.vertex_bytes / (1024.0 * 1024.0),
+        time * 1e3);
+}
+
+// How much of the level hidden-face removal leaves out: triangles and vertex
+// buffer size with every bale whole versus with the back faces (away from the
+// camera) and the back of the faces against neighbouring bales gone, on map0
+// and on a dense 1024x1024 map.
+// Only counts, so no GL context is needed; the measuring time includes
+// building the bale variants the first time they're used.
+static void
+bench_level_mesh(void) {
+    const int32_t size = 1024;
+
+    struct static_mesh bale = {0};
+    make_synthetic_bale(&bale, 16);
+
+    struct level_mesh level = {0};
+    level_mesh_init(&level, &bale);
+
+    // Three quarters hay, like a maze that's mostly walls.
+    struct map big = { .width = size, .height = size };
+    big.data = eng_zalloc((size_t)size * size);
+    uint32_t state = 1;
+    for(size_t i = 0; i < (size_t)size * size; ++i) {
+        state = state * 1664525u + 1013904223u;
+        big.data[i] = ((state >> 24) % 4 != 0) ? CELL_HAY : CELL_EMPTY;
+    }
+
+    printf("level_mesh: %zu triangles per bale\n", bale.triangles_count / 3);
+    printf("  %-10s %12s %12s %9s %12s %12s %11s\n", "map", "triangles", "after", "removed",
+        "vertices", "after", "measure");
+    print_level_size("map0", &level, &map0);
+    print_level_size("1024x1024", &level, &big);
+
+    level_mesh_free(&level);
+    eng_free(big.data, (size_t)size * size);
+    stm_destroy(&bale);
+}
+
+struct bench {
+    const char *name;
+    void (*run)(void);
+};
+
+static struct bench benches[] = {
+    { "anim_step", bench_anim_step },
+    { "anim_sample", bench_anim_sample },
+    { "anim_quantized", bench_anim_quantized },
+    { "pose_blend", bench_pose_blend },
+    { "bone_pose", bench_bone_pose },
+    { "palette", bench_palette },
+    { "horde", bench_horde },
+    { "vertex_pack", bench_vertex_pack },
+    { "serialize_write", bench_serialize_write },
+    { "level_mesh", bench_level_mesh },
+};
+
+int
+main(int argc, char **argv) {
+    const size_t bench_count = sizeof(benches) / sizeof(benches[0]);
+
+    for(size_t i = 0; i < bench_count; ++i) {
+        bool wanted = (argc < 2);
+        for(int a = 1; a < argc; ++a) {
+            if(!strcmp(argv[a], benches[i].name)) wanted = true;
+        }
+
+        if(wanted) benches[i].run();
+    }
+
+    return 0;
+}